@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -16,18 +16,75 @@ SOURCES += main.cpp\
         mainwindow.cpp \
     canvas.cpp \
     state.cpp \
-    layer.cpp
+    layer.cpp \
+    raster.cpp \
+    compositor.cpp \
+    kernels.cpp \
+    mask.cpp \
+    rle.cpp \
+    tiles.cpp \
+    maskio.cpp \
+    maskbench.cpp \
+    source.cpp \
+    tiled.cpp \
+    tiffsource.cpp \
+    compressedsource.cpp \
+    classifier.cpp \
+    grabcut.cpp \
+    watershed.cpp \
+    prediction.cpp \
+    uncertainty.cpp \
+    disagreement.cpp \
+    components.cpp \
+    wand.cpp \
+    scissors.cpp \
+    cleanup.cpp \
+    outline.cpp \
+    thumbnails.cpp \
+    filmstrip.cpp
 
 HEADERS  += mainwindow.h \
     canvas.h \
     state.h \
-    layer.h
+    layer.h \
+    raster.h \
+    compositor.h \
+    kernels.h \
+    mask.h \
+    rle.h \
+    tiles.h \
+    maskio.h \
+    maskbench.h \
+    source.h \
+    tiled.h \
+    tiffsource.h \
+    compressedsource.h \
+    classifier.h \
+    grabcut.h \
+    watershed.h \
+    prediction.h \
+    uncertainty.h \
+    disagreement.h \
+    components.h \
+    wand.h \
+    scissors.h \
+    cleanup.h \
+    labels.h \
+    outline.h \
+    thumbnails.h \
+    filmstrip.h
 
 FORMS    += mainwindow.ui
 
 CONFIG += c++11 
+
+# 16 bit labels for more than 255 classes, qmake CONFIG+=labels16
+labels16 {
+    DEFINES += LABELS_16
+}
+
 QMAKE_CXXFLAGS += --std=c++11 `pkg-config opencv --cflags` -ltiff
-LIBS = `pkg-config --libs opencv`
+LIBS = `pkg-config --libs opencv` -ltiff
 
 RESOURCES += \
     icons.qrc
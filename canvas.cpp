@@ -4,8 +4,10 @@
 #include <QPolygonF>
 #include <QImage>
 #include <QRgb>
+#include <QtConcurrent>
 
 #include <set>
+#include <cmath>
 
 #include <iostream>
 
@@ -14,9 +16,13 @@
 
 QVector<QRgb> makeColorTable();
 
+// pixels the magic wand fills between frames
+static int const wandStep = 1 << 20;
+
 
 Canvas::Canvas()
-        : defaultLabel(0), currentZoom(1.0f), mode(Lines), drawing(false), overlayOpacity(50) {
+        : defaultLabel(0), currentZoom(1.0f), mode(Lines), drawing(false), loading(false), overlayOpacity(50),
+          snap(false), wandLabel(0), wandTolerance(24), ignoreLabel(-1) {
     setMouseTracking(true);
     currentPoint.r = 20.0;
 
@@ -28,42 +34,37 @@ Canvas::Canvas()
     connect( timer, SIGNAL( timeout() ), this, SLOT( repaint() ) );
 
     timer->start();
-}
 
+    wandTimer = new QTimer(this);
+    connect(wandTimer, &QTimer::timeout, this, &Canvas::stepWand);
 
+    connect(&componentLoader, &QFutureWatcher<ComponentsPtr>::finished, [=] () {
+        components = componentLoader.result();
 
+        // the prediction changed again meanwhile
+        if(components->getVersion() != layers[0]->getVersion()) {
+            updateComponents();
+            return;
+        }
 
-void Canvas::zoomIn() {
-    zoom(std::min<float>(4, currentZoom / 0.95));
-}
+        if(pendingAccept) {
+            acceptComponent(*pendingAccept);
+            pendingAccept.reset();
 
-void Canvas::zoomOut() {
-    zoom(std::max<float>(0.25, currentZoom * 0.95));
+            emit edited();
+        }
+    });
 }
 
 
-void Canvas::genScaledImage() {
-
-    if(!image.empty()) {
 
-        cv::Mat3b m = image.clone();
 
-        if(!overlay.empty()) {
-            cv::cvtColor(overlay, m, cv::COLOR_GRAY2BGR);
-            cv::scaleAdd(m, -(overlayOpacity / 100.0), image, m);
-        }
-
-        cv::Mat3b s(image.rows * currentZoom, image.cols * currentZoom);
-
-        int interp = currentZoom < 1 ? cv::INTER_AREA : cv::INTER_CUBIC;
-        cv::resize(m, s, s.size(), currentZoom, currentZoom, interp);
-
-        QImage i(s.data, s.cols, s.rows, s.step, QImage::Format_RGB888);
-        scaled = QPixmap::fromImage(i.copy());
+void Canvas::zoomIn() {
+    zoom(std::min<float>(4, currentZoom / 0.95));
+}
 
-    } else {
-        scaled = QPixmap();
-    }
+void Canvas::zoomOut() {
+    zoom(std::max<float>(0.25, currentZoom * 0.95));
 }
 
 
@@ -71,22 +72,25 @@ void Canvas::zoom(float level) {
 
     currentZoom = level;
 
-    genScaledImage();
-    resize(scaled.size());
+    cv::Size size = imageSize();
+    resize(size.width * currentZoom, size.height * currentZoom);
+    update();
 }
 
 
 
-void Canvas::setImage(cv::Mat3b const &image_) {
+void Canvas::setImage(SourcePtr const &image_) {
 
     cancel();
 
     overlay = cv::Mat1b();
     spLabels = cv::Mat1b();
     image = image_;
+    compositor.invalidate();
 
+    cv::Size size = imageSize();
     for (auto const& l : layers) {
-        l->reset(image.rows, image.cols);
+        l->reset(size.height, size.width);
     }
 
 
@@ -96,8 +100,21 @@ void Canvas::setImage(cv::Mat3b const &image_) {
     undos.clear();
     redos.clear();
 
+    loading = false;
+    unsetCursor();
+
     zoom(currentZoom);
     resetLog();
+
+    edgeCosts.reset();
+    updateEdgeCost();
+}
+
+void Canvas::setPreview(SourcePtr const &preview) {
+    setImage(preview);
+
+    loading = true;
+    setCursor(Qt::BusyCursor);
 }
 
 void Canvas::setLabel(int label) {
@@ -110,8 +127,9 @@ void Canvas::setLabel(int label) {
 inline cv::Point2f Canvas::getPosition(QMouseEvent *event) {
 
     cv::Point2f p(event->x() / currentZoom, event->y() / currentZoom);
-    p.x = std::min<float>(p.x, image.cols - 1);
-    p.y = std::min<float>(p.y, image.rows - 1);
+    cv::Size size = imageSize();
+    p.x = std::min<float>(p.x, size.width - 1);
+    p.y = std::min<float>(p.y, size.height - 1);
 
     p.x = std::max<float>(p.x, 0.0f);
     p.y = std::max<float>(p.y, 0.0f);
@@ -120,6 +138,8 @@ inline cv::Point2f Canvas::getPosition(QMouseEvent *event) {
 }
 
 void Canvas::mousePressEvent(QMouseEvent *event) {
+    if(loading) return;
+
     cv::Point2f p = getPosition(event);
     logEvent("click");
 
@@ -160,6 +180,7 @@ void Canvas::mousePressEvent(QMouseEvent *event) {
 
         currentPoint.p = p;
         activeLayer->drawPoint(currentPoint, currentLabel);
+        stroke = {currentPoint};
 
         logEvent("begin points");
         drawing = true;
@@ -172,10 +193,24 @@ void Canvas::mousePressEvent(QMouseEvent *event) {
                 logEvent("begin polygon");
 
 
-            currentPoly.push_back(p);
+            addWire(p);
         } else {
 
-            currentPoly.push_back(p);
+            addWire(p);
+
+            // closed along the edges too
+            if(wire && currentPoly.size() > 1) {
+                wire = std::make_shared<LiveWire>(edgeCosts, cv::Point(p));
+                std::vector<cv::Point> closing = wire->path(cv::Point(currentPoly.front()));
+
+                for(size_t i = 1; i + 1 < closing.size(); ++i) {
+                    currentPoly.push_back(closing[i]);
+                }
+            }
+
+            wire.reset();
+            wirePath.clear();
+
             if(currentPoly.size() > 2) {
                 logEvent("end polygon");
                 snapshot();
@@ -195,6 +230,16 @@ void Canvas::mousePressEvent(QMouseEvent *event) {
 
         logEvent("begin superpixels");
         drawing = true;
+    break;
+
+    case Accept:
+        acceptComponent(p);
+    break;
+
+    case Wand:
+        startWand(p);
+    break;
+
     default:
     break;
     }
@@ -202,18 +247,163 @@ void Canvas::mousePressEvent(QMouseEvent *event) {
     //this->repaint();
 }
 
+void Canvas::acceptComponent(cv::Point const &p) {
+    LayerPtr prediction = layers[0];
+    if(activeLayer == prediction)
+        return;
+
+    // accepted once the index has caught up with the prediction
+    if(!components || components->getVersion() != prediction->getVersion()) {
+        pendingAccept = p;
+        updateComponents();
+
+        return;
+    }
+
+    int c = components->find(p);
+    if(c < 0)
+        return;
+
+    // copying these would erase the labels under them
+    int label = components->label(c);
+    if(label == ignoreLabel || label == activeLayer->getDefaultLabel())
+        return;
+
+    snapshot();
+    activeLayer->fillSpans(components->spans(c), label);
+
+    logEvent("accept");
+}
+
+void Canvas::updateComponents() {
+    LayerPtr prediction = layers[0];
+    if(componentLoader.isRunning() || (components && components->getVersion() == prediction->getVersion()))
+        return;
+
+    MaskPtr mask = prediction->snapshot();
+    int version = prediction->getVersion();
+
+    if(!mask)
+        return;
+
+    componentLoader.setFuture(QtConcurrent::run([=] () {
+        return std::make_shared<ComponentIndex const>(*mask, version);
+    }));
+}
+
+void Canvas::setSnap(bool on) {
+    snap = on;
+
+    if(!snap) edgeCosts.reset();
+    updateEdgeCost();
+}
+
+void Canvas::updateEdgeCost() {
+    if(!snap || !image || loading || edgeCosts)
+        return;
+
+    // computed as the live wire reaches each part of the image
+    edgeCosts = std::make_shared<EdgeCosts>(image);
+}
+
+bool Canvas::snapping() const {
+    return snap && edgeCosts && !loading;
+}
+
+
+void Canvas::addWire(cv::Point2f const &p) {
+    if(!snapping()) {
+        currentPoly.push_back(p);
+        return;
+    }
+
+    // the path starts at the last vertex, which is already there
+    if(wire) {
+        std::vector<cv::Point> path = wire->path(cv::Point(p));
+        if(path.empty()) path.push_back(cv::Point(p));
+
+        for(size_t i = 1; i < path.size(); ++i) {
+            currentPoly.push_back(path[i]);
+        }
+    } else {
+        currentPoly.push_back(cv::Point(p));
+    }
+
+    wire = std::make_shared<LiveWire>(edgeCosts, cv::Point(p));
+    wirePath.clear();
+}
+
+
+void Canvas::startWand(cv::Point const &p) {
+    stopWand();
+
+    // without a selection a fill stops at the edge of the view
+    cv::Rect bounds = selection ? cv::Rect(*selection) & cv::Rect(cv::Point(), imageSize()) : viewRect();
+    if(!bounds.contains(p))
+        return;
+
+    snapshot();
+
+    wand = std::make_shared<MagicWand>(image, p, wandTolerance, bounds);
+    wandLayer = activeLayer;
+    wandLabel = currentLabel;
+
+    logEvent("wand");
+
+    // small fills finish here, larger ones continue between frames
+    stepWand();
+    if(wand) wandTimer->start(0);
+}
+
+void Canvas::stepWand() {
+    if(!wand)
+        return;
+
+    Spans spans;
+    bool more = wand->step(wandStep, spans);
+
+    wandLayer->fillSpans(spans, wandLabel);
+    update();
+
+    if(!more) stopWand();
+}
+
+void Canvas::stopWand() {
+    wandTimer->stop();
+
+    // a fill stopped part way keeps what it has filled
+    bool filled = wand && wand->filled() > 0;
+
+    wand.reset();
+    wandLayer.reset();
+
+    if(filled) emit edited();
+}
+
 cv::Rect2f Canvas::getSelection() {
     if(selection) {
         return *selection;
     } else {
-        return cv::Rect2f(0, 0, image.cols, image.rows);
+        return cv::Rect2f(cv::Point2f(), imageSize());
     }
 }
 
 void Canvas::deleteSelection() {
+    if(loading) return;
+
     snapshot();
 
     activeLayer->clearRect(getSelection());
+    emit edited();
+}
+
+cv::Rect Canvas::viewRect() {
+    QRect r = visibleRegion().boundingRect();
+
+    cv::Rect view(cv::Point(r.left() / currentZoom, r.top() / currentZoom),
+                  cv::Point(std::ceil((r.right() + 1) / currentZoom), std::ceil((r.bottom() + 1) / currentZoom)));
+
+    return view & cv::Rect(cv::Point(), imageSize());
 }
 
 
@@ -244,8 +434,7 @@ void Canvas::mouseMove(QMouseEvent *event) {
     switch(mode) {
     case Points:
         if(drawing) {
-            activeLayer->drawPoint(currentPoint, currentLabel);
-
+            stroke.push_back(currentPoint);
         }
     break;
 
@@ -257,6 +446,12 @@ void Canvas::mouseMove(QMouseEvent *event) {
         }
     break;
 
+    case Polygons:
+        if(wire) {
+            wirePath = wire->path(p);
+        }
+    break;
+
     default: break;
     }
 
@@ -266,6 +461,8 @@ void Canvas::mouseMove(QMouseEvent *event) {
 
 
 void Canvas::mouseReleaseEvent(QMouseEvent *event) {
+    if(loading) return;
+
     mouseMove(event);
 
     if(selecting) {
@@ -278,10 +475,14 @@ void Canvas::mouseReleaseEvent(QMouseEvent *event) {
     }
 
     if(drawing) {
+        flushStroke();
         logEvent("end points");
     }
 
     drawing = false;
+    stroke.clear();
+
+    emit edited();
     //repaint();
 }
 
@@ -290,41 +491,40 @@ void Canvas::mouseMoveEvent(QMouseEvent *event) {
 }
 
 
+void Canvas::flushStroke() {
+    if(stroke.size() > 1) {
+        activeLayer->drawStroke(stroke, currentLabel);
+        stroke.erase(stroke.begin(), stroke.end() - 1);
+    }
+}
 
 
-void Canvas::paintEvent(QPaintEvent * /* event */) {
-    QPainter painter(this);
-
-    painter.fillRect(rect(), QColor(Qt::gray));
-    painter.drawPixmap(0, 0, scaled);
-
-    painter.scale(currentZoom, currentZoom);
 
-    QPen pen;
-    pen.setWidth(2);
-    painter.setPen(pen);
 
+void Canvas::paintEvent(QPaintEvent *event) {
+    flushStroke();
 
-    QPixmap pm;
-    cv::Mat1b edit;
+    // kept up to date as the prediction changes, ready for a click
+    if(mode == Accept) updateComponents();
 
-    if(mode == Lines && currentLine) {
-        edit = activeLayer->getMask().clone();
-        activeLayer->drawLine(*currentLine, currentPoint, currentLabel);
-    }
+    QPainter painter(this);
 
+    painter.fillRect(rect(), QColor(Qt::gray));
 
-    painter.setRenderHint(QPainter::Antialiasing, false);
+    QRect region = event->rect() & visibleRegion().boundingRect();
+    if(image) {
+        QImage const &composite = compositor.render(region, currentZoom, *image, overlay, overlayOpacity, layers);
 
-    for (auto const& layer : layers) {
-        painter.setOpacity(float(layer->getOpacity()) / 100.0f);
-        painter.drawPixmap(0, 0,  layer->getPixmap());
+        if(!composite.isNull()) {
+            painter.drawImage(region.topLeft(), composite);
+        }
     }
 
+    painter.scale(currentZoom, currentZoom);
 
-    if(mode == Lines && currentLine) {
-        activeLayer->setMask(edit);
-    }
+    QPen pen;
+    pen.setWidth(2);
+    painter.setPen(pen);
 
     painter.setOpacity(1);
 
@@ -352,6 +552,11 @@ void Canvas::paintEvent(QPaintEvent * /* event */) {
         painter.drawEllipse(QPointF(currentPoint.p.x, currentPoint.p.y), currentPoint.r, currentPoint.r);
     break;
     case Lines:
+        if(currentLine) {
+            painter.setPen(QPen(lc, currentLine->r + currentPoint.r, Qt::SolidLine, Qt::RoundCap));
+            painter.drawLine(QPointF(currentLine->p.x, currentLine->p.y), QPointF(currentPoint.p.x, currentPoint.p.y));
+            painter.setPen(pen);
+        }
 
         painter.setBrush(QBrush(lc));
         painter.drawEllipse(QPointF(currentPoint.p.x, currentPoint.p.y), currentPoint.r, currentPoint.r);
@@ -364,8 +569,15 @@ void Canvas::paintEvent(QPaintEvent * /* event */) {
             points.push_back(QPointF(p.x, p.y));
         }
 
-        points.push_back(QPointF(currentPoint.p.x, currentPoint.p.y));
-        painter.drawPolygon(&points.front(), currentPoly.size() + 1);
+        if(wire && wirePath.size() > 1) {
+            for(size_t i = 1; i < wirePath.size(); ++i) {
+                points.push_back(QPointF(wirePath[i].x, wirePath[i].y));
+            }
+        } else {
+            points.push_back(QPointF(currentPoint.p.x, currentPoint.p.y));
+        }
+
+        painter.drawPolygon(&points.front(), int(points.size()));
     }
     break;
 
@@ -373,6 +585,23 @@ void Canvas::paintEvent(QPaintEvent * /* event */) {
     default: break;
     }
 
+    if(selection && mode != Selection) {
+        painter.setBrush(Qt::NoBrush);
+        painter.setPen(QPen(QColor(0, 127, 127), 2 / currentZoom, Qt::DashLine));
+        painter.drawRect(QRectF(selection->x, selection->y, selection->width, selection->height));
+    }
+
+    if(highlight) {
+        painter.setBrush(Qt::NoBrush);
+        painter.setPen(QPen(Qt::red, 2 / currentZoom, Qt::DashLine));
+        painter.drawRect(QRectF(highlight->x, highlight->y, highlight->width, highlight->height));
+    }
+}
+
+
+void Canvas::setHighlight(cv::Rect const &r) {
+    highlight = r;
+    update();
 }
 
 
@@ -386,14 +615,25 @@ void Canvas::setBrushWidth(int width) {
 
 void Canvas::cancel() {
    selection.reset();
+   highlight.reset();
+
+   // what's been filled so far stays, undo removes it
+   stopWand();
+   pendingAccept.reset();
+
+   wire.reset();
+   wirePath.clear();
 
    if(currentLine) logEvent("end lines");
    else if(drawing) logEvent("end points");
    else if(!currentPoly.empty()) logEvent("end polygons");
 
 
+   flushStroke();
+
    currentPoly.clear();
    currentLine.reset();
+   stroke.clear();
    drawing = false;
 
    //repaint();
@@ -401,44 +641,6 @@ void Canvas::cancel() {
 
 
 
-//void Canvas::grabCut() {
-
-//    cv::Mat cutImage = image;
-
-//    if(int(probs.size()) > currentLabel) {
-
-//        std::vector<cv::Mat1b> channels;
-//        cv::split(image, channels);
-//        cv::Mat1b rb, gb;
-
-//        cv::addWeighted(channels[0], 0.5, channels[2], 0.5, 0.0, rb);
-//        cv::addWeighted(channels[1], 0.5, channels[2], 0.5, 0.0, gb);
-
-//        std::vector<cv::Mat1b> new_channels = {rb, gb, probs[currentLabel]};
-//        cv::merge(channels, cutImage);
-//    }
-
-
-//    cv::Mat1b m(mask.rows, mask.cols);
-//    m.setTo(cv::GC_PR_BGD);
-
-//    m.setTo(cv::GC_BGD,    (mask == 0));
-//    m.setTo(cv::GC_PR_FGD,    (mask == 1));
-
-
-//    cv::Mat fgModel, bgModel;
-//    cv::grabCut(cutImage, m, cv::Rect(), fgModel, bgModel, 2, cv::GC_INIT_WITH_MASK);
-
-//    cv::Mat1b result(mask.rows, mask.cols);
-//    result.setTo(0);
-
-//    result.setTo(1, (m == cv::GC_FGD) | (m == cv::GC_PR_FGD));
-//    setMask(result);
-
-//}
-
-
-
 //void Canvas::genOverlay() {
 //    using namespace cv::ximgproc;
 //    overlay = cv::Mat1b();
@@ -473,7 +675,12 @@ void Canvas::cancel() {
 
 
 void Canvas::setMode(DrawMode mode_) {
+    // the selection stays, e.g. to bound a fill
+    auto kept = selection;
+
     cancel();
+
+    selection = kept;
     mode = mode_;
 }
 
@@ -483,10 +690,11 @@ void Canvas::undo() {
     cancel();
     if(undos.size()) {
 
-        redos.push_back(getState());
+        redos.push_back(currentState(undos.back()));
         setState(undos.back());
 
         undos.pop_back();
+        emit edited();
     }
 
     //repaint();
@@ -497,10 +705,11 @@ void Canvas::redo() {
     cancel();
 
     if(redos.size()) {
-        undos.push_back(getState());
+        undos.push_back(currentState(redos.back()));
         setState(redos.back());
 
         redos.pop_back();
+        emit edited();
     }
 
    // repaint();
@@ -5,12 +5,18 @@
 #include <QWidget>
 #include <QTimer>
 #include <QTime>
+#include <QFutureWatcher>
 #include "state.h"
 
 #include <boost/optional.hpp>
 #include <boost/variant.hpp>
 
 #include "layer.h"
+#include "compositor.h"
+#include "components.h"
+#include "wand.h"
+#include "scissors.h"
+#include "rle.h"
 
 #include "opencv2/core.hpp"
 
@@ -20,15 +26,22 @@ enum DrawMode {
     Points,
     Fill,
     SuperPixels,
-    Polygons
+    Polygons,
+    Accept,
+    Wand
 };
 
 
 struct Image {
+    Image() : preview(false), copied(0) {}
 
-    cv::Mat3b image;
-    cv::Mat1b labels;
-    cv::Mat1b prediction;
+    SourcePtr image;
+    bool preview;   // image is a reduced stand in, masks not yet loaded
+
+    size_t copied;  // bytes of pixels copied after decoding, ideally none
+
+    MaskPtr labels;
+    LabelMat prediction;
 
     std::vector<cv::Mat1b> probs;
 };
@@ -49,9 +62,17 @@ public:
 
 
 //void setConfig(Config const &c);
-    void setImage(cv::Mat3b const &image);
+    void setImage(SourcePtr const &image);
+
+    // Shown while the full image loads, drawing is disabled until setImage
+    void setPreview(SourcePtr const &preview);
+    bool isLoading() const { return loading; }
 
-    cv::Mat3b const& getImage() const { return image; }
+    SourcePtr const& getImage() const { return image; }
+
+    cv::Size imageSize() const {
+        return image ? image->size() : cv::Size();
+    }
 
     bool isModified() { return undos.size() || redos.size(); }
 
@@ -81,6 +102,8 @@ public slots:
     void zoom(float zoom);
 
     void setLabel(int label);
+    int getLabel() const { return currentLabel; }
+
     void setBrushWidth(int width);
 
     void setMode(DrawMode mode);
@@ -95,16 +118,30 @@ public slots:
         overlay = overlay_;
         spLabels = spLabels_;
 
+        compositor.invalidate();
         setMode(SuperPixels);
     }
 
 
     void setPolygons() { setMode(Polygons); }
 
+    // Polygon edges follow image edges between the clicked vertices
+    void setSnap(bool on);
+
+    // Clicks copy the predicted component under them into the active layer
+    void setAccept() { setMode(Accept); }
+
+    // Clicks fill the image colour under them, within the selection or else the view
+    void setWand() { setMode(Wand); }
+    void setWandTolerance(int tolerance) { wandTolerance = tolerance; }
+
+    // Components of the prediction with this label can't be accepted
+    void setIgnoreLabel(int label) { ignoreLabel = label; }
+
 
     void setOverlayOpacity(int n) {
         overlayOpacity = n;
-        genScaledImage();
+        update();
     }
 
     LayerPtr getLayer(int i) {
@@ -121,8 +158,8 @@ public slots:
     }
 
     void setActiveLayer(int i) {
-        activeLayer = layers[i];
         cancel();
+        activeLayer = layers[i];
     }
 
 
@@ -141,10 +178,29 @@ public slots:
         redos.clear();
     }
 
+    // An undo step holding only r of the active layer
+    void snapshot(cv::Rect const &r) {
+        undos.push_back(getState(activeLayer, r));
+        redos.clear();
+    }
+
+    LayerPtr const &getActiveLayer() const { return activeLayer; }
+
+    // The part of the image in view
+    cv::Rect viewRect();
+
+    float getZoom() const { return currentZoom; }
+
+    // Outline a region, e.g. one to review, until the next cancel
+    void setHighlight(cv::Rect const &r);
+
 signals:
 
     void brushWidthChanged(int size);
 
+    // Labels were changed by an edit, undo or redo
+    void edited();
+
 protected:
 
 
@@ -158,31 +214,74 @@ protected:
     void mouseMoveEvent(QMouseEvent *event);
     void mouseReleaseEvent(QMouseEvent *event);
 
-    void genScaledImage();
     cv::Point2f getPosition(QMouseEvent *event);
 
 
-    typedef std::vector<cv::Mat1b> State;
+    // Every layer, or one region of a layer
+    struct State {
+        std::vector<MaskPtr> masks;
+        std::vector<MaskPtr> marks;     // of layers which are marking
+
+        LayerPtr layer;
+        cv::Rect rect;
+        MaskPtr region;
+        MaskPtr regionMarks;
+    };
 
     State getState() {
-        std::vector<cv::Mat1b> masks;
+        State state;
 
         for(auto const& l : layers) {
-            masks.push_back(l->getMask().clone());
+            state.masks.push_back(l->snapshot());
+            state.marks.push_back(l->snapshotMarks());
         }
-        return masks;
+        return state;
+    }
+
+    State getState(LayerPtr const &layer, cv::Rect const &r) {
+        State state;
+
+        state.layer = layer;
+        state.rect = r;
+        state.region = compactMask(layer->getRegion(r));
+
+        if(layer->isMarking()) state.regionMarks = compactMask(layer->getMarks(r));
+        return state;
+    }
+
+    // The current labels of what state covers, to go the other way
+    State currentState(State const &state) {
+        return state.layer ? getState(state.layer, state.rect) : getState();
     }
 
     void setState(State const& state) {
+        if(state.layer) {
+            state.layer->setRegion(state.rect, state.region->dense());
+            if(state.regionMarks) state.layer->setMarks(state.rect, state.regionMarks->dense());
+        }
 
-        for(size_t i = 0; i < state.size(); ++i) {
-            layers[i]->setMask(state[i]);
+        for(size_t i = 0; i < state.masks.size(); ++i) {
+            layers[i]->restore(state.masks[i], state.marks[i]);
         }
     }
 
 
 private:
     void mouseMove(QMouseEvent *event);
+    void flushStroke();
+
+    void acceptComponent(cv::Point const &p);
+
+    void updateEdgeCost();
+    void updateComponents();
+    bool snapping() const;
+
+    // Vertices along the live wire from the last vertex to p
+    void addWire(cv::Point2f const &p);
+
+    void startWand(cv::Point const &p);
+    void stepWand();
+    void stopWand();
 
 
     boost::optional<Point> currentLine;
@@ -190,6 +289,9 @@ private:
 
     Point currentPoint;
 
+    // brush samples queued since the last frame, the first is the last one drawn
+    std::vector<Point> stroke;
+
     int defaultLabel;
 
     int currentLabel;
@@ -197,17 +299,40 @@ private:
 
     DrawMode mode;
     bool drawing;
+    bool loading;
 
     boost::optional<cv::Rect2f> selection;
     boost::optional<cv::Point2f> selecting;
+    boost::optional<cv::Rect> highlight;
 
-    cv::Mat3b image;
+    SourcePtr image;
     cv::Mat1i spLabels;
 
     int overlayOpacity;
     cv::Mat1b overlay;
 
-    QPixmap scaled;
+    Compositor compositor;
+
+    // of the prediction layer, rebuilt in the background when it has changed
+    ComponentsPtr components;
+    QFutureWatcher<ComponentsPtr> componentLoader;
+    boost::optional<cv::Point> pendingAccept;   // clicked while being rebuilt
+
+    // edge costs of the image for snapping polygons
+    bool snap;
+    CostPtr edgeCosts;
+
+    std::shared_ptr<LiveWire> wire;      // from the last polygon vertex
+    std::vector<cv::Point> wirePath;     // to the cursor
+
+    // a fill in progress, continued by wandTimer
+    std::shared_ptr<MagicWand> wand;
+    LayerPtr wandLayer;
+    int wandLabel;
+    int wandTolerance;
+    QTimer *wandTimer;
+
+    int ignoreLabel;    // of the prediction, never accepted
 
     std::vector<LayerPtr> layers;
 
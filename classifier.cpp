@@ -0,0 +1,421 @@
+#include "classifier.h"
+
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <random>
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/ml.hpp>
+
+
+namespace {
+
+    // pixels around a tile needed by the widest filter
+    int const margin = 12;
+
+    // labelled pixels kept for training, per class
+    int const samplesPerClass = 4000;
+
+    // tiles of features kept between runs (each ~2.6MB), more if the view needs them
+    size_t const maxCached = 64;
+
+    // larger images are only predicted around the view
+    int64_t const wholeImageArea = int64_t(64) << 20;
+
+
+    cv::Mat1f gradient(cv::Mat1f const &l, double sigma) {
+        cv::Mat1f smooth, dx, dy, mag;
+        cv::GaussianBlur(l, smooth, cv::Size(), sigma);
+
+        cv::Sobel(smooth, dx, CV_32F, 1, 0);
+        cv::Sobel(smooth, dy, CV_32F, 0, 1);
+        cv::magnitude(dx, dy, mag);
+
+        return mag;
+    }
+
+
+    cv::Rect tileRect(int tx, int ty, cv::Size const &size) {
+        int tileSize = Classifier::tileSize;
+        return cv::Rect(tx * tileSize, ty * tileSize, tileSize, tileSize) & cv::Rect(cv::Point(), size);
+    }
+}
+
+
+cv::Mat pixelFeatures(cv::Mat4b const &pixels) {
+    cv::Mat3b bgr;
+    cv::cvtColor(pixels, bgr, cv::COLOR_BGRA2BGR);
+
+    cv::Mat3f lab;
+    bgr.convertTo(lab, CV_32F, 1.0 / 255.0);
+    cv::cvtColor(lab, lab, cv::COLOR_BGR2Lab);
+
+    std::vector<cv::Mat1f> channels;
+    cv::split(lab, channels);
+    cv::Mat1f l = channels[0];
+
+    cv::Mat3f smooth;
+    cv::GaussianBlur(lab, smooth, cv::Size(), 3);
+    cv::split(smooth, channels);
+
+    cv::Mat1f mean, square, contrast;
+    cv::GaussianBlur(l, mean, cv::Size(), 3);
+    cv::GaussianBlur(l.mul(l), square, cv::Size(), 3);
+    cv::sqrt(cv::max(square - mean.mul(mean), 0), contrast);
+
+    cv::Mat1f blurred, laplacian;
+    cv::GaussianBlur(l, blurred, cv::Size(), 2);
+    cv::Laplacian(blurred, laplacian, CV_32F);
+
+    std::vector<cv::Mat> planes;
+    cv::split(lab, planes);
+    planes.insert(planes.end(), channels.begin(), channels.end());
+    planes.push_back(gradient(l, 1));
+    planes.push_back(gradient(l, 3));
+    planes.push_back(contrast);
+    planes.push_back(laplacian);
+
+    cv::Mat features;
+    cv::merge(planes, features);
+
+    return features;
+}
+
+
+Classifier::Classifier(QObject *parent)
+    : QObject(parent), generation(0), uses(0), capacity(maxCached) {
+    qRegisterMetaType<PredictedTile>();
+}
+
+Classifier::~Classifier() {
+    cancel();
+    pool.waitForDone();
+}
+
+
+int Classifier::start(SourcePtr const &source, MaskPtr const &labels, int ignore, cv::Rect const &view, cv::Rect const &edited) {
+    int id;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        id = ++generation;
+        if(edited.area()) dirty = dirty.area() ? (dirty | edited) : edited;
+    }
+
+    QtConcurrent::run(&pool, [=] () {
+        run(id, source, labels, ignore, view);
+    });
+
+    return id;
+}
+
+void Classifier::cancel() {
+    ++generation;
+}
+
+
+Classifier::FeaturesPtr Classifier::tileFeatures(SourcePtr const &source, cv::Rect const &tile, bool evict) {
+    auto key = std::make_pair(tile.x, tile.y);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(source != cachedSource) {
+            features.clear();
+            cachedSource = source;
+        }
+
+        auto i = features.find(key);
+        if(i != features.end()) {
+            i->second.used = ++uses;
+            return i->second.features;
+        }
+    }
+
+    cv::Rect bounds(cv::Point(), source->size());
+    cv::Rect outer = cv::Rect(tile.x - margin, tile.y - margin, tile.width + 2 * margin, tile.height + 2 * margin) & bounds;
+
+    cv::Mat4b pixels;
+    source->read(outer, pixels);
+
+    cv::Mat inner = pixelFeatures(pixels)(tile - outer.tl()).clone();
+    auto result = std::make_shared<cv::Mat1f const>(inner.reshape(1, tile.area()));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if(source != cachedSource)
+        return result;
+
+    // least recently used goes, for tiles in view
+    if(features.size() >= capacity) {
+        if(!evict) return result;
+
+        auto oldest = std::min_element(features.begin(), features.end(), [](CacheEntry const &a, CacheEntry const &b) {
+            return a.second.used < b.second.used;
+        });
+
+        features.erase(oldest);
+    }
+
+    features[key] = Cached {result, ++uses};
+    return result;
+}
+
+
+bool Classifier::sampleAll(int id, MaskPtr const &labels, int ignore, std::mt19937 &random, Samples &samples) {
+    cv::Size size = labels->size();
+
+    samples.seen.assign(labelCount, 0);
+    samples.classes.assign(labelCount, std::vector<Sample>());
+
+    std::vector<label_t> buffer(size.width);
+
+    // reservoir of labelled pixels for each class
+    for(int y = 0; y < size.height; ++y) {
+        if(cancelled(id)) return false;
+
+        int label;
+        if(labels->uniform(y, 0, size.width, label) && label == ignore)
+            continue;
+
+        label_t const *row = labels->row(y, 0, size.width, buffer.data());
+
+        for(int x = 0; x < size.width; ++x) {
+            if(row[x] == ignore) continue;
+
+            auto &c = samples.classes[row[x]];
+            int64_t n = samples.seen[row[x]]++;
+
+            if(n < samplesPerClass) {
+                c.push_back(Sample(x, y, row[x]));
+            } else {
+                int64_t i = std::uniform_int_distribution<int64_t>(0, n)(random);
+                if(i < samplesPerClass) c[i] = Sample(x, y, row[x]);
+            }
+        }
+    }
+
+    return true;
+}
+
+
+bool Classifier::resample(int id, MaskPtr const &labels, cv::Rect const &r, std::mt19937 &random, Samples &samples) {
+    int ignore = samples.ignore;
+    std::vector<label_t> before(r.width), after(r.width);
+
+    // classes counted again over the edit
+    for(int y = r.y; y < r.br().y; ++y) {
+        if(cancelled(id)) return false;
+
+        label_t const *old = samples.labels->row(y, r.x, r.br().x, before.data());
+        label_t const *now = labels->row(y, r.x, r.br().x, after.data());
+
+        for(int x = 0; x < r.width; ++x) {
+            if(old[x] != ignore) --samples.seen[old[x]];
+            if(now[x] != ignore) ++samples.seen[now[x]];
+        }
+    }
+
+    for(auto &c : samples.classes) {
+        c.erase(std::remove_if(c.begin(), c.end(), [&](Sample const &s) {
+            return r.contains(cv::Point(s.x, s.y));
+        }), c.end());
+    }
+
+    // pixels of the edit are sampled as densely as the rest of their class was
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    for(int y = r.y; y < r.br().y; ++y) {
+        int label;
+        if(labels->uniform(y, r.x, r.br().x, label) && label == ignore)
+            continue;
+
+        label_t const *now = labels->row(y, r.x, r.br().x, after.data());
+
+        for(int x = 0; x < r.width; ++x) {
+            int l = now[x];
+
+            if(l != ignore && uniform(random) * samples.seen[l] < samplesPerClass)
+                samples.classes[l].push_back(Sample(r.x + x, y, l));
+        }
+    }
+
+    for(auto &c : samples.classes) {
+        while(c.size() > size_t(samplesPerClass)) {
+            size_t i = std::uniform_int_distribution<size_t>(0, c.size() - 1)(random);
+
+            c[i] = c.back();
+            c.pop_back();
+        }
+    }
+
+    return true;
+}
+
+
+bool Classifier::findFeatures(int id, SourcePtr const &source, cv::Rect const &view, Samples &samples) {
+    cv::Size size = source->size();
+
+    // samples without features grouped by tile, so each tile's features are computed once
+    std::map<std::pair<int, int>, std::vector<Sample*>> byTile;
+
+    for(auto &c : samples.classes) {
+        for(auto &s : c) {
+            if(!s.found) byTile[std::make_pair(s.x / tileSize, s.y / tileSize)].push_back(&s);
+        }
+    }
+
+    std::vector<std::pair<std::pair<int, int>, std::vector<Sample*>>> tiles(byTile.begin(), byTile.end());
+
+    cv::parallel_for_(cv::Range(0, int(tiles.size())), [&](cv::Range const &range) {
+        for(int k = range.start; k < range.end; ++k) {
+            if(cancelled(id)) return;
+
+            cv::Rect r = tileRect(tiles[k].first.first, tiles[k].first.second, size);
+            FeaturesPtr f = tileFeatures(source, r, (r & view).area() > 0);
+
+            for(Sample *s : tiles[k].second) {
+                float const *row = f->ptr<float>((s->y - r.y) * r.width + (s->x - r.x));
+
+                std::copy(row, row + featureCount, s->features);
+                s->found = true;
+            }
+        }
+    });
+
+    return !cancelled(id);
+}
+
+
+void Classifier::run(int id, SourcePtr source, MaskPtr labels, int ignore, cv::Rect view) {
+    cv::Size size = source->size();
+    if(labels->size() != size)
+        return;
+
+    cv::Rect all(cv::Point(), size);
+    view &= all;
+
+    Samples samples;
+    cv::Rect edited;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        samples = sampled;
+        edited = dirty;
+
+        // the tiles in view stay cached between runs
+        int viewTiles = view.area() ? ((view.br().x - 1) / tileSize - view.x / tileSize + 1) * ((view.br().y - 1) / tileSize - view.y / tileSize + 1) : 0;
+        capacity = std::max(maxCached, size_t(viewTiles));
+    }
+
+    std::mt19937 random(id);
+
+    // the last run's samples are kept, other than those of the pixels edited since
+    bool same = samples.source == source && samples.labels && samples.labels->size() == size && samples.ignore == ignore;
+
+    if(!same || (edited & all) == all) {
+        if(!sampleAll(id, labels, ignore, random, samples))
+            return;
+
+    } else if((edited & all).area()) {
+        if(!resample(id, labels, edited & all, random, samples))
+            return;
+    }
+
+    samples.source = source;
+    samples.labels = labels;
+    samples.ignore = ignore;
+
+    if(!findFeatures(id, source, view, samples))
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(cancelled(id)) return;
+
+        sampled = samples;
+        dirty = cv::Rect();
+    }
+
+    int classes = 0, count = 0;
+    for(auto const &c : samples.classes) {
+        if(!c.empty()) ++classes;
+        count += int(c.size());
+    }
+
+    if(classes < 2)
+        return;
+
+    cv::Mat1f trainData(count, featureCount);
+    cv::Mat1i responses(count, 1);
+
+    int i = 0;
+    for(auto const &c : samples.classes) {
+        for(auto const &s : c) {
+            std::copy(s.features, s.features + featureCount, trainData.ptr<float>(i));
+            responses(i++) = s.label;
+        }
+    }
+
+    auto trees = cv::ml::RTrees::create();
+    trees->setMaxDepth(12);
+    trees->setMinSampleCount(5);
+    trees->setTermCriteria(cv::TermCriteria(cv::TermCriteria::MAX_ITER, 32, 0));
+
+    trees->train(cv::ml::TrainData::create(trainData, cv::ml::ROW_SAMPLE, responses));
+
+    // tiles in view first, then outwards from its centre
+    std::vector<cv::Point> order;
+    cv::Rect area = int64_t(size.width) * size.height <= wholeImageArea ? all :
+            cv::Rect(view.x - view.width, view.y - view.height, view.width * 3, view.height * 3) & all;
+
+    for(int ty = area.y / tileSize; ty * tileSize < area.br().y; ++ty) {
+        for(int tx = area.x / tileSize; tx * tileSize < area.br().x; ++tx) {
+            order.push_back(cv::Point(tx, ty));
+        }
+    }
+
+    cv::Point2f centre(view.x + view.width * 0.5f, view.y + view.height * 0.5f);
+    auto priority = [&](cv::Point const &t) {
+        cv::Rect r = tileRect(t.x, t.y, size);
+        cv::Point2f d = cv::Point2f(r.x + r.width * 0.5f, r.y + r.height * 0.5f) - centre;
+
+        return std::make_pair((r & view).area() == 0, d.dot(d));
+    };
+
+    std::sort(order.begin(), order.end(), [&](cv::Point const &a, cv::Point const &b) {
+        return priority(a) < priority(b);
+    });
+
+    // features of a batch of tiles in parallel, predictions are parallel inside
+    size_t batch = std::max(1, cv::getNumThreads());
+
+    for(size_t i = 0; i < order.size(); i += batch) {
+        if(cancelled(id)) return;
+
+        size_t n = std::min(batch, order.size() - i);
+        std::vector<FeaturesPtr> batchFeatures(n);
+
+        cv::parallel_for_(cv::Range(0, n), [&](cv::Range const &range) {
+            for(int k = range.start; k < range.end; ++k) {
+                cv::Rect r = tileRect(order[i + k].x, order[i + k].y, size);
+                batchFeatures[k] = tileFeatures(source, r, (r & view).area() > 0);
+            }
+        });
+
+        for(size_t k = 0; k < n; ++k) {
+            if(cancelled(id)) return;
+
+            PredictedTile tile;
+            tile.run = id;
+            tile.rect = tileRect(order[i + k].x, order[i + k].y, size);
+
+            cv::Mat1f predictions;
+            trees->predict(*batchFeatures[k], predictions);
+
+            predictions.reshape(1, tile.rect.height).convertTo(tile.labels, cv::DataType<label_t>::depth);
+            emit predicted(tile);
+        }
+    }
+}
@@ -0,0 +1,121 @@
+#ifndef CLASSIFIER_H
+#define CLASSIFIER_H
+
+#include <QObject>
+#include <QThreadPool>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <random>
+
+#include "opencv2/core.hpp"
+
+#include "source.h"
+#include "mask.h"
+
+
+// Labels predicted for one tile by a run of the classifier
+struct PredictedTile {
+    PredictedTile() : run(0) {}
+
+    int run;
+    cv::Rect rect;
+    LabelMat labels;
+};
+
+Q_DECLARE_METATYPE(PredictedTile)
+
+
+// Per pixel colour (Lab), smoothed colour, gradient magnitude at two
+// scales, local contrast and a Laplacian of Gaussian, as a CV_32FC(featureCount) image
+enum { featureCount = 10 };
+cv::Mat pixelFeatures(cv::Mat4b const &pixels);
+
+
+// Random trees trained in the background on the labelled pixels of a mask,
+// predicting tile by tile with the tiles in view first. Starting a new run
+// abandons the last one, results of a run arrive as predicted signals.
+// Samples of the labelled pixels and their features are kept between runs,
+// only the pixels edited since are sampled again.
+class Classifier : public QObject {
+    Q_OBJECT
+
+public:
+    enum { tileSize = 256 };
+
+    Classifier(QObject *parent = nullptr);
+    ~Classifier();
+
+    // Train on the pixels of labels not equal to ignore, returns the run
+    // number. edited bounds the changes to labels since the last start.
+    int start(SourcePtr const &source, MaskPtr const &labels, int ignore, cv::Rect const &view, cv::Rect const &edited);
+    void cancel();
+
+    int currentRun() const { return generation; }
+
+signals:
+    void predicted(PredictedTile const &tile);
+
+private:
+    typedef std::shared_ptr<cv::Mat1f const> FeaturesPtr;
+
+    struct Sample {
+        Sample(int x, int y, int label) : x(x), y(y), label(label), found(false) {}
+
+        int x, y, label;
+
+        bool found;
+        float features[featureCount];
+    };
+
+    // Labelled pixels sampled for training, of each class
+    struct Samples {
+        Samples() : ignore(-1) {}
+
+        SourcePtr source;
+        MaskPtr labels;         // sampled from
+        int ignore;
+
+        std::vector<int64_t> seen;      // labelled pixels of each class
+        std::vector<std::vector<Sample>> classes;
+    };
+
+    struct Cached {
+        FeaturesPtr features;
+        uint64_t used;
+    };
+
+    typedef std::pair<std::pair<int, int> const, Cached> CacheEntry;
+
+    void run(int id, SourcePtr source, MaskPtr labels, int ignore, cv::Rect view);
+
+    // Reservoir of each class over all of labels
+    bool sampleAll(int id, MaskPtr const &labels, int ignore, std::mt19937 &random, Samples &samples);
+
+    // Samples and counts of r taken again from labels, the rest kept
+    bool resample(int id, MaskPtr const &labels, cv::Rect const &r, std::mt19937 &random, Samples &samples);
+
+    // Features of the samples which don't have them, tiles in parallel
+    bool findFeatures(int id, SourcePtr const &source, cv::Rect const &view, Samples &samples);
+
+    // Features of a tile as one row per pixel, cached for the current source.
+    // Tiles which evict replace the least recently used when the cache is full.
+    FeaturesPtr tileFeatures(SourcePtr const &source, cv::Rect const &tile, bool evict);
+
+    bool cancelled(int id) const { return generation != id; }
+
+    std::atomic<int> generation;
+    QThreadPool pool;       // of every run, an abandoned one may still be training
+
+    std::mutex mutex;
+    SourcePtr cachedSource;
+    std::map<std::pair<int, int>, Cached> features;
+    uint64_t uses;
+    size_t capacity;
+
+    Samples sampled;        // of the last run to finish sampling
+    cv::Rect dirty;         // edited since sampled
+};
+
+#endif // CLASSIFIER_H
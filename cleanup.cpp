@@ -0,0 +1,367 @@
+#include "cleanup.h"
+#include "kernels.h"
+#include "raster.h"
+
+#include <map>
+#include <numeric>
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+
+namespace {
+
+    enum { bandRows = 256 };
+
+    int root(std::vector<int> &parent, int i) {
+        while(parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+
+        return i;
+    }
+
+    int bandCount(int rows) {
+        return (rows + bandRows - 1) / bandRows;
+    }
+
+    cv::Range bandRange(int b, int rows) {
+        return cv::Range(b * bandRows, std::min(rows, (b + 1) * bandRows));
+    }
+
+
+    struct Band {
+        std::vector<int> area;
+        std::vector<int> labels;
+    };
+
+    // Components of rows [r.start, r.end) numbered from 0 within the band
+    template<typename T>
+    Band labelBand(cv::Mat_<T> const &labels, cv::Mat1i &ids, cv::Range const &r) {
+        Spans runs;
+        std::vector<int> parent;
+
+        int prevStart = 0, prevEnd = 0;
+
+        for(int y = r.start; y < r.end; ++y) {
+            int start = int(runs.size());
+            T const *row = labels.template ptr<T>(y);
+
+            for(int x = 0; x < labels.cols; ) {
+                int n = runLength(row + x, labels.cols - x);
+
+                parent.push_back(int(runs.size()));
+                runs.push_back(Span(y, x, x + n));
+                x += n;
+            }
+
+            int end = int(runs.size());
+
+            // join overlapping runs of the same label on the row above
+            for(int i = prevStart, j = start; i < prevEnd && j < end; ) {
+                Span const &a = runs[i], &b = runs[j];
+
+                if(a.x0 < b.x1 && b.x0 < a.x1 && labels(a.y, a.x0) == labels(b.y, b.x0)) {
+                    parent[root(parent, i)] = root(parent, j);
+                }
+
+                if(a.x1 < b.x1) ++i;
+                else ++j;
+            }
+
+            prevStart = start;
+            prevEnd = end;
+        }
+
+        Band band;
+        std::vector<int> number(runs.size(), -1);
+
+        for(size_t i = 0; i < runs.size(); ++i) {
+            Span const &s = runs[i];
+            int c = root(parent, int(i));
+
+            if(number[c] < 0) {
+                number[c] = int(band.area.size());
+                band.area.push_back(0);
+                band.labels.push_back(labels(s.y, s.x0));
+            }
+
+            c = number[c];
+            band.area[c] += s.x1 - s.x0;
+
+            int *dst = ids.ptr<int>(s.y);
+            std::fill(dst + s.x0, dst + s.x1, c);
+        }
+
+        return band;
+    }
+}
+
+
+template<typename T>
+Components findComponents(cv::Mat_<T> const &labels) {
+    Components c;
+    c.ids.create(labels.size());
+
+    int bands = bandCount(labels.rows);
+    std::vector<Band> local(bands);
+
+    cv::parallel_for_(cv::Range(0, bands), [&](cv::Range const &range) {
+        for(int b = range.start; b < range.end; ++b) {
+            local[b] = labelBand(labels, c.ids, bandRange(b, labels.rows));
+        }
+    });
+
+    std::vector<int> offsets(bands + 1, 0);
+    for(int b = 0; b < bands; ++b) {
+        offsets[b + 1] = offsets[b] + int(local[b].area.size());
+    }
+
+    // join components meeting across each seam
+    std::vector<int> parent(offsets.back());
+    std::iota(parent.begin(), parent.end(), 0);
+
+    for(int b = 1; b < bands; ++b) {
+        int y = b * bandRows;
+
+        T const *above = labels.template ptr<T>(y - 1), *below = labels.template ptr<T>(y);
+        int const *upper = c.ids.ptr<int>(y - 1), *lower = c.ids.ptr<int>(y);
+
+        for(int x = 0; x < labels.cols; ++x) {
+            if(above[x] == below[x]) {
+                parent[root(parent, offsets[b - 1] + upper[x])] = root(parent, offsets[b] + lower[x]);
+            }
+        }
+    }
+
+    std::vector<int> global(parent.size()), number(parent.size(), -1);
+
+    for(int b = 0; b < bands; ++b) {
+        for(size_t i = 0; i < local[b].area.size(); ++i) {
+            int k = offsets[b] + int(i);
+            int r = root(parent, k);
+
+            if(number[r] < 0) {
+                number[r] = int(c.area.size());
+                c.area.push_back(0);
+                c.labels.push_back(local[b].labels[i]);
+            }
+
+            global[k] = number[r];
+            c.area[global[k]] += local[b].area[i];
+        }
+    }
+
+    cv::parallel_for_(cv::Range(0, bands), [&](cv::Range const &range) {
+        for(int b = range.start; b < range.end; ++b) {
+            cv::Range rows = bandRange(b, labels.rows);
+
+            for(int y = rows.start; y < rows.end; ++y) {
+                int *id = c.ids.ptr<int>(y);
+
+                for(int x = 0; x < labels.cols; ++x) {
+                    id[x] = global[offsets[b] + id[x]];
+                }
+            }
+        }
+    });
+
+    c.border.assign(c.area.size(), 0);
+
+    for(int y = 0; y < labels.rows; ++y) {
+        int const *id = c.ids.ptr<int>(y);
+
+        if(y == 0 || y == labels.rows - 1) {
+            for(int x = 0; x < labels.cols; ++x) c.border[id[x]] = 1;
+        } else if(labels.cols) {
+            c.border[id[0]] = c.border[id[labels.cols - 1]] = 1;
+        }
+    }
+
+    return c;
+}
+
+template Components findComponents(cv::Mat_<uint8_t> const &labels);
+template Components findComponents(cv::Mat_<uint16_t> const &labels);
+
+
+void removeIslands(LabelMat &labels, int minArea, int ignore, bool open) {
+    if(labels.empty())
+        return;
+
+    Components c = findComponents(labels);
+
+    std::vector<uint8_t> small(c.area.size());
+    bool any = false;
+
+    for(size_t i = 0; i < small.size(); ++i) {
+        small[i] = c.area[i] < minArea && !(open && c.border[i]);
+        any = any || small[i];
+    }
+
+    if(!any)
+        return;
+
+    // (component, label) -> length of the boundary between them
+    typedef std::map<std::pair<int, int>, int> Votes;
+
+    int bands = bandCount(labels.rows);
+    std::vector<Votes> local(bands);
+
+    cv::parallel_for_(cv::Range(0, bands), [&](cv::Range const &range) {
+        for(int b = range.start; b < range.end; ++b) {
+            cv::Range rows = bandRange(b, labels.rows);
+            Votes &votes = local[b];
+
+            // component i borders a pixel of label l
+            auto vote = [&](int i, int l) {
+                if(small[i] && l != ignore) ++votes[std::make_pair(i, l)];
+            };
+
+            for(int y = rows.start; y < rows.end; ++y) {
+                int const *id = c.ids.ptr<int>(y);
+                label_t const *l = labels.ptr<label_t>(y);
+
+                int const *nextId = y + 1 < labels.rows ? c.ids.ptr<int>(y + 1) : nullptr;
+                label_t const *next = y + 1 < labels.rows ? labels.ptr<label_t>(y + 1) : nullptr;
+
+                for(int x = 0; x < labels.cols; ++x) {
+                    if(x + 1 < labels.cols && l[x] != l[x + 1]) {
+                        vote(id[x], l[x + 1]);
+                        vote(id[x + 1], l[x]);
+                    }
+
+                    if(next && l[x] != next[x]) {
+                        vote(id[x], next[x]);
+                        vote(nextId[x], l[x]);
+                    }
+                }
+            }
+        }
+    });
+
+    Votes &votes = local[0];
+    for(int b = 1; b < bands; ++b) {
+        for(auto const &v : local[b]) votes[v.first] += v.second;
+    }
+
+    std::vector<int> best(c.area.size(), 0);
+    std::vector<int> replace(c.labels);
+
+    for(auto const &v : votes) {
+        int i = v.first.first;
+        if(v.second > best[i]) {
+            best[i] = v.second;
+            replace[i] = v.first.second;
+        }
+    }
+
+    cv::parallel_for_(cv::Range(0, bands), [&](cv::Range const &range) {
+        for(int b = range.start; b < range.end; ++b) {
+            cv::Range rows = bandRange(b, labels.rows);
+
+            for(int y = rows.start; y < rows.end; ++y) {
+                int const *id = c.ids.ptr<int>(y);
+                label_t *l = labels.ptr<label_t>(y);
+
+                for(int x = 0; x < labels.cols; ++x) {
+                    l[x] = label_t(replace[id[x]]);
+                }
+            }
+        }
+    });
+}
+
+
+void fillHoles(LabelMat &labels, int label, int maxArea) {
+    if(labels.empty())
+        return;
+
+    cv::Mat1b inside = labels == label;
+    Components c = findComponents(inside);
+
+    std::vector<uint8_t> fill(c.area.size());
+    for(size_t i = 0; i < fill.size(); ++i) {
+        fill[i] = !c.labels[i] && !c.border[i] && c.area[i] <= maxArea;
+    }
+
+    cv::parallel_for_(cv::Range(0, labels.rows), [&](cv::Range const &rows) {
+        for(int y = rows.start; y < rows.end; ++y) {
+            int const *id = c.ids.ptr<int>(y);
+            label_t *l = labels.ptr<label_t>(y);
+
+            for(int x = 0; x < labels.cols; ++x) {
+                if(fill[id[x]]) l[x] = label_t(label);
+            }
+        }
+    });
+}
+
+
+void smoothBoundaries(LabelMat &labels, int radius, int ignore) {
+    radius = std::min(radius, 127);
+    if(labels.empty() || radius < 1)
+        return;
+
+    LabelMat src = labels.clone();
+    cv::Size window(2 * radius + 1, 2 * radius + 1);
+
+    cv::parallel_for_(cv::Range(0, bandCount(labels.rows)), [&](cv::Range const &range) {
+        for(int b = range.start; b < range.end; ++b) {
+            cv::Range rows = bandRange(b, labels.rows);
+
+            // with enough rows around the band that its counts are exact
+            int p0 = std::max(0, rows.start - radius);
+            LabelMat padded = src.rowRange(p0, std::min(labels.rows, rows.end + radius));
+
+            std::vector<uint8_t> present(labelCount, 0);
+            std::vector<int> classes;
+
+            for(int y = 0; y < padded.rows; ++y) {
+                label_t const *l = padded.ptr<label_t>(y);
+                for(int x = 0; x < padded.cols; ) {
+                    int n = runLength(l + x, padded.cols - x);
+
+                    if(!present[l[x]]) classes.push_back(l[x]);
+                    present[l[x]] = 1;
+                    x += n;
+                }
+            }
+
+            // lowest label first, so other ties go the same way in every band
+            std::sort(classes.begin(), classes.end());
+
+            cv::Mat1w best(rows.size(), labels.cols, uint16_t(0));
+            cv::Mat1b indicator;
+            cv::Mat1w count;
+
+            for(int k : classes) {
+                if(k == ignore)
+                    continue;
+
+                cv::compare(padded, k, indicator, cv::CMP_EQ);
+                cv::bitwise_and(indicator, 1, indicator);
+                cv::boxFilter(indicator, count, CV_16U, window, cv::Point(-1, -1), false, cv::BORDER_REPLICATE);
+
+                for(int y = rows.start; y < rows.end; ++y) {
+                    uint16_t const *n = count.ptr<uint16_t>(y - p0);
+                    uint16_t *most = best.ptr<uint16_t>(y - rows.start);
+
+                    label_t const *s = src.ptr<label_t>(y);
+                    label_t *d = labels.ptr<label_t>(y);
+
+                    for(int x = 0; x < labels.cols; ++x) {
+                        if(s[x] == ignore)
+                            continue;
+
+                        if(n[x] > most[x] || (n[x] == most[x] && s[x] == k)) {
+                            most[x] = n[x];
+                            d[x] = label_t(k);
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,37 @@
+#ifndef CLEANUP_H
+#define CLEANUP_H
+
+#include <vector>
+
+#include "opencv2/core.hpp"
+#include "labels.h"
+
+
+// Connected components (4-connected pixels of one label) of a region,
+// labelled in bands of rows in parallel and joined across the band seams.
+struct Components {
+    cv::Mat1i ids;
+
+    std::vector<int> area;
+    std::vector<int> labels;
+    std::vector<uint8_t> border;     // reaches the edge of the region
+};
+
+// Of labels or of a binary mask
+template<typename T>
+Components findComponents(cv::Mat_<T> const &labels);
+
+
+// Components smaller than minArea take the label most common around them,
+// other than ignore. When labels is part of a larger image (open), those
+// reaching its edge may continue outside and are kept.
+void removeIslands(LabelMat &labels, int minArea, int ignore, bool open);
+
+// Enclosed regions of anything other than label, up to maxArea, become label
+void fillHoles(LabelMat &labels, int label, int maxArea);
+
+// Majority filter over a square of side 2 * radius + 1, ties keep the label.
+// Pixels of ignore neither vote nor change.
+void smoothBoundaries(LabelMat &labels, int radius, int ignore);
+
+#endif // CLEANUP_H
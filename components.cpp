@@ -0,0 +1,124 @@
+#include "components.h"
+#include "kernels.h"
+
+#include <numeric>
+#include <algorithm>
+
+
+namespace {
+
+    int root(std::vector<int> &parent, int i) {
+        while(parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+
+        return i;
+    }
+}
+
+
+ComponentIndex::ComponentIndex(MaskStore const &mask, int version)
+    : version(version) {
+
+    cv::Size size = mask.size();
+    std::vector<label_t> buffer(size.width);
+    std::vector<int> runLabels;
+
+    rowStart.reserve(size.height + 1);
+
+    for(int y = 0; y < size.height; ++y) {
+        rowStart.push_back(int(runs.size()));
+
+        int label;
+        if(mask.uniform(y, 0, size.width, label)) {
+            runs.push_back(Span(y, 0, size.width));
+            runLabels.push_back(label);
+            continue;
+        }
+
+        label_t const *row = mask.row(y, 0, size.width, buffer.data());
+        for(int x = 0; x < size.width; ) {
+            int n = runLength(row + x, size.width - x);
+
+            runs.push_back(Span(y, x, x + n));
+            runLabels.push_back(row[x]);
+            x += n;
+        }
+    }
+
+    rowStart.push_back(int(runs.size()));
+
+    // join overlapping runs of the same label on consecutive rows
+    std::vector<int> parent(runs.size());
+    std::iota(parent.begin(), parent.end(), 0);
+
+    for(int y = 1; y < size.height; ++y) {
+        int i = rowStart[y - 1], j = rowStart[y];
+
+        while(i < rowStart[y] && j < rowStart[y + 1]) {
+            Span const &a = runs[i], &b = runs[j];
+
+            if(a.x0 < b.x1 && b.x0 < a.x1 && runLabels[i] == runLabels[j]) {
+                parent[root(parent, i)] = root(parent, j);
+            }
+
+            if(a.x1 < b.x1) ++i;
+            else ++j;
+        }
+    }
+
+    std::vector<int> &component = owner;
+    component.assign(runs.size(), -1);
+
+    std::vector<int> count;
+
+    for(size_t i = 0; i < runs.size(); ++i) {
+        int r = root(parent, int(i));
+
+        if(component[r] < 0) {
+            component[r] = int(labels.size());
+            labels.push_back(runLabels[i]);
+            count.push_back(0);
+        }
+
+        component[i] = component[r];
+        ++count[component[i]];
+    }
+
+    offsets.assign(labels.size() + 1, 0);
+    std::partial_sum(count.begin(), count.end(), offsets.begin() + 1);
+
+    members.resize(runs.size());
+    std::vector<int> next(offsets.begin(), offsets.end() - 1);
+
+    for(size_t i = 0; i < runs.size(); ++i) {
+        members[next[component[i]]++] = int(i);
+    }
+}
+
+
+int ComponentIndex::find(cv::Point const &p) const {
+    if(p.y < 0 || p.y + 1 >= int(rowStart.size()))
+        return -1;
+
+    auto begin = runs.begin() + rowStart[p.y], end = runs.begin() + rowStart[p.y + 1];
+    auto i = std::upper_bound(begin, end, p.x, [](int x, Span const &s) { return x < s.x0; });
+
+    if(i == begin || p.x >= (i - 1)->x1)
+        return -1;
+
+    return owner[(i - 1) - runs.begin()];
+}
+
+
+Spans ComponentIndex::spans(int c) const {
+    Spans s;
+    s.reserve(offsets[c + 1] - offsets[c]);
+
+    for(int i = offsets[c]; i < offsets[c + 1]; ++i) {
+        s.push_back(runs[members[i]]);
+    }
+
+    return s;
+}
@@ -0,0 +1,48 @@
+#ifndef COMPONENTS_H
+#define COMPONENTS_H
+
+#include <vector>
+
+#include "opencv2/core.hpp"
+
+#include "raster.h"
+#include "layer.h"
+
+
+// Connected components (4-connected runs of one label) of a layer, stored as
+// the spans of each component. Finding the component under a point is a
+// search within one row, and copying it touches only its own pixels.
+class ComponentIndex {
+
+public:
+    ComponentIndex() : version(-1) {}
+
+    // Of a snapshot of a layer at version, so it can be built on another thread
+    ComponentIndex(MaskStore const &mask, int version);
+
+    // Component under p, -1 if p is outside the layer
+    int find(cv::Point const &p) const;
+
+    int label(int c) const { return labels[c]; }
+    Spans spans(int c) const;
+
+    // Of the layer the index was built from
+    int getVersion() const { return version; }
+
+private:
+    std::vector<Span> runs;         // row by row, left to right
+    std::vector<int> owner;         // component of each run
+    std::vector<int> rowStart;      // first run of each row, and the end
+
+    std::vector<int> labels;        // of each component
+
+    // runs of component c are members[offsets[c]] .. members[offsets[c + 1] - 1]
+    std::vector<int> offsets;
+    std::vector<int> members;
+
+    int version;
+};
+
+typedef std::shared_ptr<ComponentIndex const> ComponentsPtr;
+
+#endif // COMPONENTS_H
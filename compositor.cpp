@@ -0,0 +1,323 @@
+#include "compositor.h"
+
+#include <opencv2/imgproc.hpp>
+
+
+template<typename T>
+void scaleRegion(cv::Mat_<T> const &src, QRect const &r, float zoom, cv::Mat_<T> &dst) {
+
+    if(zoom == 1.0f) {
+        dst = src(cv::Rect(r.x(), r.y(), r.width(), r.height()));
+        return;
+    }
+
+    // dst may still be a view of the source from a previous zoom
+    dst = cv::Mat_<T>();
+
+    if(zoom < 1.0f) {
+        cv::Rect roi(cv::Point(std::floor(r.left() / zoom), std::floor(r.top() / zoom)),
+                     cv::Point(std::ceil((r.right() + 1) / zoom), std::ceil((r.bottom() + 1) / zoom)));
+
+        roi &= cv::Rect(0, 0, src.cols, src.rows);
+        cv::resize(src(roi), dst, cv::Size(r.width(), r.height()), 0, 0, cv::INTER_AREA);
+
+    } else {
+        // map each output pixel centre back to the source
+        cv::Matx23f m(1 / zoom, 0, (r.x() + 0.5f) / zoom - 0.5f,
+                      0, 1 / zoom, (r.y() + 0.5f) / zoom - 0.5f);
+
+        cv::warpAffine(src, dst, m, cv::Size(r.width(), r.height()),
+                       cv::INTER_CUBIC | cv::WARP_INVERSE_MAP, cv::BORDER_REPLICATE);
+    }
+}
+
+
+// As scaleRegion, reading only the source pixels under r
+void scaleSource(ImageSource const &source, QRect const &r, float zoom, cv::Mat4b &dst) {
+    cv::Rect image(cv::Point(), source.size());
+
+    if(zoom == 1.0f) {
+        source.read(cv::Rect(r.x(), r.y(), r.width(), r.height()), dst);
+        return;
+    }
+
+    dst = cv::Mat4b();
+
+    if(zoom < 1.0f) {
+        cv::Rect roi(cv::Point(std::floor(r.left() / zoom), std::floor(r.top() / zoom)),
+                     cv::Point(std::ceil((r.right() + 1) / zoom), std::ceil((r.bottom() + 1) / zoom)));
+
+        source.readScaled(roi & image, cv::Size(r.width(), r.height()), dst);
+
+    } else {
+        // with a margin for the cubic kernel
+        cv::Rect roi(cv::Point(std::floor(r.left() / zoom) - 2, std::floor(r.top() / zoom) - 2),
+                     cv::Point(std::ceil((r.right() + 1) / zoom) + 2, std::ceil((r.bottom() + 1) / zoom) + 2));
+        roi &= image;
+
+        cv::Mat4b src;
+        source.read(roi, src);
+
+        cv::Matx23f m(1 / zoom, 0, (r.x() + 0.5f) / zoom - 0.5f - roi.x,
+                      0, 1 / zoom, (r.y() + 0.5f) / zoom - 0.5f - roi.y);
+
+        cv::warpAffine(src, dst, m, cv::Size(r.width(), r.height()),
+                       cv::INTER_CUBIC | cv::WARP_INVERSE_MAP, cv::BORDER_REPLICATE);
+    }
+}
+
+
+QImage const &Compositor::render(QRect const &rect, float zoom_, ImageSource const &source,
+                                 cv::Mat1b const &overlay, int overlayOpacity_, std::vector<LayerPtr> const &layers) {
+
+    cv::Size image = source.size();
+
+    QRect bounds = rect & QRect(0, 0, int(image.width * zoom_), int(image.height * zoom_));
+    if(bounds.isEmpty()) {
+        buffer = QImage();
+        return buffer;
+    }
+
+    int width = bounds.width();
+    int height = bounds.height();
+
+    bool moved = bounds != region || zoom_ != zoom;
+    bool changed = moved || buffer.isNull();
+
+    if(moved) {
+        region = bounds;
+        zoom = zoom_;
+
+        scaleSource(source, bounds, zoom, scaledImage);
+
+        if(!overlay.empty()) {
+            scaleRegion(overlay, bounds, zoom, scaledOverlay);
+        } else {
+            scaledOverlay = cv::Mat1b();
+        }
+
+        // source column of each output column, relative to the first
+        columns.resize(width);
+        for(int i = 0; i < width; ++i) {
+            columns[i] = std::min<int>(image.width - 1, (bounds.x() + i + 0.5f) / zoom);
+        }
+
+        sourceColumns = cv::Range(columns.front(), columns.back() + 1);
+        for(int &c : columns) {
+            c -= sourceColumns.start;
+        }
+
+        labels.resize(sourceColumns.size());
+    }
+
+    if(moved || overlayOpacity_ != overlayOpacity) {
+        overlayOpacity = overlayOpacity_;
+        int weight = (overlayOpacity * 256) / 100;
+
+        background.resize(width * height);
+        for(int y = 0; y < height; ++y) {
+            packPixels(scaledImage.ptr<uint32_t>(y), scaledOverlay.empty() ? nullptr : scaledOverlay.ptr(y),
+                    weight, &background[y * width], width);
+        }
+
+        changed = true;
+    }
+
+    tiles.resize(layers.size());
+    for(size_t k = 0; k < layers.size(); ++k) {
+        Layer const &layer = *layers[k];
+        LayerTile &tile = tiles[k];
+
+        bool redrawn = moved || tile.layer != &layer || tile.version != layer.getVersion();
+        bool outlined = layer.isOutlined() && layer.size() == image;
+
+        if(redrawn || tile.opacity != layer.getOpacity() || tile.outlined != outlined) {
+            makeBlendLut(layer.getPalette(), outlined ? 100 : layer.getOpacity(), tile.lut);
+            changed = true;
+        }
+
+        if(outlined && (redrawn || !tile.outlined)) {
+            traceOutline(layer, tile);
+        } else if(!outlined && tile.outlined) {
+            tile.outlines.reset();
+            tile.outline.clear();
+        }
+
+        if(redrawn && zoom != 1.0f && layer.size() == image) {
+            tile.labels.resize(width * height);
+            tile.uniform.resize(height);
+
+            for(int y = 0; y < height; ++y) {
+                int row = std::min<int>(image.height - 1, (bounds.y() + y + 0.5f) / zoom);
+
+                int label;
+                if(layer.uniform(row, sourceColumns.start, sourceColumns.end, label)) {
+                    tile.uniform[y] = label;
+                    continue;
+                }
+
+                label_t const *src = layer.row(row, sourceColumns.start, sourceColumns.end, labels.data());
+                gatherLabels(src, columns.data(), &tile.labels[y * width], width);
+
+                tile.uniform[y] = -1;
+            }
+        }
+
+        tile.layer = &layer;
+        tile.version = layer.getVersion();
+        tile.opacity = layer.getOpacity();
+        tile.outlined = outlined;
+    }
+
+    if(!changed) {
+        return buffer;
+    }
+
+    if(buffer.size() != bounds.size()) {
+        buffer = QImage(bounds.size(), QImage::Format_RGB32);
+    }
+
+    for(int y = 0; y < height; ++y) {
+        uint32_t *dst = reinterpret_cast<uint32_t*>(buffer.scanLine(y));
+        std::copy(&background[y * width], &background[y * width] + width, dst);
+
+        int row = std::min<int>(image.height - 1, (bounds.y() + y + 0.5f) / zoom);
+
+        for(size_t k = 0; k < layers.size(); ++k) {
+            Layer const &layer = *layers[k];
+            if(layer.size() != image) continue;
+
+            BlendLut const &lut = tiles[k].lut;
+
+            uint8_t const *outline = nullptr;
+            if(tiles[k].outlined) {
+                if(!tiles[k].outlineRows[y]) continue;
+                outline = &tiles[k].outline[y * width];
+            }
+
+            int label = -1;
+            label_t const *src = nullptr;
+
+            if(zoom == 1.0f) {
+                if(!layer.uniform(row, bounds.x(), bounds.x() + width, label)) {
+                    src = layer.row(row, bounds.x(), bounds.x() + width, labels.data());
+                }
+            } else {
+                label = tiles[k].uniform[y];
+                src = &tiles[k].labels[y * width];
+            }
+
+            // just the spans under lines
+            if(outline) {
+                for(int x = 0; x < width; ) {
+                    int n = runLength(outline + x, width - x);
+
+                    if(outline[x]) {
+                        if(label < 0) {
+                            blendLabels(src + x, lut, dst + x, n);
+                        } else if(lut.inv[label] < 256) {
+                            blendSolid(lut.pre[label], lut.inv[label], dst + x, n);
+                        }
+                    }
+
+                    x += n;
+                }
+
+            // rows covered by unwritten tiles or long runs
+            } else if(label >= 0) {
+                if(lut.inv[label] < 256) blendSolid(lut.pre[label], lut.inv[label], dst, width);
+            } else {
+                blendLabels(src, lut, dst, width);
+            }
+        }
+    }
+
+    return buffer;
+}
+
+
+void Compositor::traceOutline(Layer const &layer, LayerTile &tile) {
+    cv::Size image = layer.size();
+    int width = region.width(), height = region.height();
+
+    // source pixel under each output pixel, and under the one after the last
+    std::vector<int> xs(width + 1), ys(height + 1);
+
+    for(int i = 0; i <= width; ++i) {
+        xs[i] = std::min<int>(image.width - 1, (region.x() + i + 0.5f) / zoom);
+    }
+
+    for(int i = 0; i <= height; ++i) {
+        ys[i] = std::min<int>(image.height - 1, (region.y() + i + 0.5f) / zoom);
+    }
+
+    cv::Rect source(cv::Point(xs[0], ys[0]), cv::Point(xs[width] + 1, ys[height] + 1));
+    tile.outlines.update(layer, source);
+
+    // a boundary after an output pixel where one lies between its source
+    // pixel and that of the next, so lines are as thin zoomed in as out
+    boundaries.assign(width * height, 0);
+    edges.resize(source.width);
+
+    for(int y = 0; y < height; ++y) {
+        uint8_t *b = &boundaries[y * width];
+
+        tile.outlines.row(ys[y], source.x, source.br().x, edges.data());
+        uint8_t const *e = edges.data() - source.x;
+
+        for(int x = 0; x < width; ++x) {
+            for(int c = xs[x]; c < xs[x + 1]; ++c) {
+                if(e[c] & Outlines::right) {
+                    b[x] = Outlines::right;
+                    break;
+                }
+            }
+        }
+
+        for(int r = ys[y]; r < ys[y + 1]; ++r) {
+            for(int x = 0; x < width; ++x) {
+                b[x] |= tile.outlines.at(xs[x], r) & Outlines::below;
+            }
+        }
+    }
+
+    // lines of outlineWidth output pixels across each boundary
+    int const lo = (outlineWidth + 1) / 2, hi = outlineWidth / 2;
+
+    tile.outline.assign(width * height, 0);
+    tile.outlineRows.assign(height, 0);
+
+    for(int y = 0; y < height; ++y) {
+        uint8_t const *b = &boundaries[y * width];
+
+        for(int x = 0; x < width; ++x) {
+            if(!b[x]) continue;
+
+            if(b[x] & Outlines::right) {
+                uint8_t *o = &tile.outline[y * width];
+                std::fill(o + std::max(0, x + 1 - lo), o + std::min(width, x + hi + 1), 1);
+
+                tile.outlineRows[y] = 1;
+            }
+
+            if(b[x] & Outlines::below) {
+                for(int j = std::max(0, y + 1 - lo); j < std::min(height, y + hi + 1); ++j) {
+                    tile.outline[j * width + x] = 1;
+                    tile.outlineRows[j] = 1;
+                }
+            }
+        }
+    }
+}
+
+
+void makeBlendLut(QVector<QRgb> const &palette, int opacity, BlendLut &lut) {
+
+    for(int i = 0; i < labelCount; ++i) {
+        QRgb c = i < palette.size() ? palette[i] : 0;
+        uint32_t a = (qAlpha(c) * opacity * 256) / (255 * 100);
+
+        lut.inv[i] = 256 - a;
+        lut.pre[i] = (((qRed(c) * a) >> 8) << 16) | (((qGreen(c) * a) >> 8) << 8) | ((qBlue(c) * a) >> 8);
+    }
+}
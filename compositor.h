@@ -0,0 +1,87 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <QImage>
+#include <QRect>
+
+#include "opencv2/core.hpp"
+
+#include "layer.h"
+#include "source.h"
+#include "kernels.h"
+#include "outline.h"
+
+
+// Builds the visible part of the canvas (image, overlay and all layers) in a
+// single pass over each output row, returned as one image ready to draw.
+// The scaled image with its overlay and the sampled labels of each layer are
+// cached, so opacity changes only cost a recomposite. Layers drawn as outlines
+// keep the boundaries of their labels, which only edits change, and trace them
+// at the current zoom with lines of a constant width on screen.
+class Compositor {
+
+public:
+    enum { outlineWidth = 2 };
+
+    Compositor() : zoom(0), overlayOpacity(-1) {}
+
+    QImage const &render(QRect const &rect, float zoom, ImageSource const &image,
+                         cv::Mat1b const &overlay, int overlayOpacity, std::vector<LayerPtr> const &layers);
+
+    // Call when the image or overlay changes, the scaled region is otherwise reused
+    void invalidate() {
+        region = QRect();
+        buffer = QImage();
+    }
+
+private:
+
+    struct LayerTile {
+        LayerTile() : layer(nullptr), version(-1), opacity(-1), outlined(false) {}
+
+        Layer const *layer;
+        int version;
+        int opacity;
+        bool outlined;
+
+        std::vector<label_t> labels;
+        std::vector<int> uniform;  // label of rows with just one, otherwise -1
+
+        Outlines outlines;
+        std::vector<uint8_t> outline;       // pixels under a line
+        std::vector<uint8_t> outlineRows;   // rows with any
+
+        BlendLut lut;
+    };
+
+    void traceOutline(Layer const &layer, LayerTile &tile);
+
+    QImage buffer;
+
+    QRect region;
+    float zoom;
+    int overlayOpacity;
+
+    cv::Mat4b scaledImage;
+    cv::Mat1b scaledOverlay;
+
+    // scaled image with the overlay applied, one row of packed pixels per output row
+    std::vector<uint32_t> background;
+
+    std::vector<int> columns;
+    cv::Range sourceColumns;
+
+    // a row of labels from stores which decode rather than point at them
+    std::vector<label_t> labels;
+
+    // boundaries after each output pixel, and edge bits of a source row
+    std::vector<uint8_t> boundaries;
+    std::vector<uint8_t> edges;
+
+    std::vector<LayerTile> tiles;
+};
+
+
+void makeBlendLut(QVector<QRgb> const &palette, int opacity, BlendLut &lut);
+
+#endif // COMPOSITOR_H
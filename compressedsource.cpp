@@ -0,0 +1,67 @@
+#include "compressedsource.h"
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+
+CompressedSource::CompressedSource(cv::Mat4b const &image, size_t cacheBytes)
+    : TiledSource(cacheBytes) {
+
+    cv::Mat4b level = image;
+    compress(level);
+
+    while(std::max(level.cols, level.rows) > 2 * tileSize) {
+        cv::Mat4b half;
+        cv::resize(level, half, cv::Size((level.cols + 1) / 2, (level.rows + 1) / 2), 0, 0, cv::INTER_AREA);
+
+        level = half;
+        compress(level);
+    }
+}
+
+
+void CompressedSource::compress(cv::Mat4b const &image) {
+    int level = levels.size();
+    levels.push_back(Level(image.size(), cv::Size(tileSize, tileSize)));
+
+    int tx = (image.cols + tileSize - 1) / tileSize;
+    int ty = (image.rows + tileSize - 1) / tileSize;
+
+    tilesX.push_back(tx);
+    tiles.push_back(std::vector<std::vector<uchar>>(tx * ty));
+
+    // PNG filtering does well on photos, at the fastest deflate level
+    std::vector<int> params = {cv::IMWRITE_PNG_COMPRESSION, 1};
+
+    cv::parallel_for_(cv::Range(0, tx * ty), [&](cv::Range const &range) {
+        cv::Mat3b bgr;
+
+        for(int i = range.start; i < range.end; ++i) {
+            cv::Rect r = tileRect(level, i % tx, i / tx);
+
+            cv::cvtColor(image(r), bgr, cv::COLOR_BGRA2BGR);
+            cv::imencode(".png", bgr, tiles[level][i], params);
+        }
+    });
+}
+
+
+cv::Mat4b CompressedSource::decodeTile(int level, int tx, int ty) const {
+    cv::Mat3b bgr = cv::imdecode(tiles[level][ty * tilesX[level] + tx], cv::IMREAD_COLOR);
+
+    cv::Mat4b pixels;
+    cv::cvtColor(bgr, pixels, cv::COLOR_BGR2BGRA);
+
+    return pixels;
+}
+
+
+size_t CompressedSource::bytes() const {
+    size_t n = 0;
+
+    for(auto const &level : tiles) {
+        for(auto const &t : level) n += t.size();
+    }
+
+    return n;
+}
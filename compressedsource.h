@@ -0,0 +1,30 @@
+#ifndef COMPRESSEDSOURCE_H
+#define COMPRESSEDSOURCE_H
+
+#include "tiled.h"
+
+
+// A decoded image held as losslessly compressed tiles, with a pyramid of
+// halved levels for zooming out. Only the tiles in view stay decoded, so
+// large images cost their compressed size plus the cache.
+class CompressedSource : public TiledSource {
+
+public:
+    enum { tileSize = 256, defaultCache = 64 << 20 };
+
+    CompressedSource(cv::Mat4b const &image, size_t cacheBytes = defaultCache);
+
+    // Compressed size of every level
+    size_t bytes() const;
+
+protected:
+    cv::Mat4b decodeTile(int level, int tx, int ty) const;
+
+private:
+    void compress(cv::Mat4b const &image);
+
+    std::vector<int> tilesX;
+    std::vector<std::vector<std::vector<uchar>>> tiles;     // per level, row major
+};
+
+#endif // COMPRESSEDSOURCE_H
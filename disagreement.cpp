@@ -0,0 +1,101 @@
+#include "disagreement.h"
+#include "kernels.h"
+
+#include <opencv2/imgproc.hpp>
+
+
+Disagreement::Disagreement()
+    : ignore(-1), predictionVersion(-1), labelsVersion(-1), ranked(false) {
+}
+
+void Disagreement::reset() {
+    diff.release();
+    ranking.clear();
+
+    predictionVersion = labelsVersion = -1;
+    ranked = false;
+}
+
+
+bool Disagreement::update(Layer const &prediction, Layer const &labels, int ignore_) {
+    cv::Size size = labels.size();
+
+    if(prediction.size() != size || size.area() == 0) {
+        reset();
+        return false;
+    }
+
+    cv::Rect dirty;
+
+    if(diff.size() != size || ignore != ignore_) {
+        diff = cv::Mat1b(size, uint8_t(0));
+        ignore = ignore_;
+
+        dirty = cv::Rect(cv::Point(), size);
+
+    } else {
+        cv::Rect p = prediction.changedSince(predictionVersion);
+        cv::Rect l = labels.changedSince(labelsVersion);
+
+        dirty = p.area() == 0 ? l : (l.area() == 0 ? p : (p | l));
+    }
+
+    predictionVersion = prediction.getVersion();
+    labelsVersion = labels.getVersion();
+
+    if(dirty.area() == 0)
+        return false;
+
+    // out to whole tiles
+    cv::Point tl((dirty.x / tileSize) * tileSize, (dirty.y / tileSize) * tileSize);
+    cv::Point br(((dirty.br().x + tileSize - 1) / tileSize) * tileSize, ((dirty.br().y + tileSize - 1) / tileSize) * tileSize);
+
+    cv::Rect bounds(cv::Point(), size);
+
+    for(int y = tl.y; y < br.y; y += tileSize) {
+        for(int x = tl.x; x < br.x; x += tileSize) {
+            cv::Rect tile = cv::Rect(x, y, tileSize, tileSize) & bounds;
+
+            LabelMat a = prediction.getRegion(tile);
+            LabelMat b = labels.getRegion(tile);
+
+            for(int i = 0; i < tile.height; ++i) {
+                diffLabels(a.ptr<label_t>(i), b.ptr<label_t>(i), ignore, diff.ptr(tile.y + i) + tile.x, tile.width);
+            }
+        }
+    }
+
+    ranked = false;
+    return true;
+}
+
+
+std::vector<Disagreement::Region> const &Disagreement::regions() {
+    if(ranked)
+        return ranking;
+
+    ranking.clear();
+    ranked = true;
+
+    if(diff.empty())
+        return ranking;
+
+    cv::Mat1i components, stats;
+    cv::Mat1d centroids;
+    int n = cv::connectedComponentsWithStats(diff, components, stats, centroids, 8, CV_32S);
+
+    for(int i = 1; i < n; ++i) {
+        int area = stats(i, cv::CC_STAT_AREA);
+        if(area < minArea)
+            continue;
+
+        cv::Rect r(stats(i, cv::CC_STAT_LEFT), stats(i, cv::CC_STAT_TOP), stats(i, cv::CC_STAT_WIDTH), stats(i, cv::CC_STAT_HEIGHT));
+        ranking.push_back(Region(r, area));
+    }
+
+    std::stable_sort(ranking.begin(), ranking.end(), [](Region const &a, Region const &b) {
+        return a.area > b.area;
+    });
+
+    return ranking;
+}
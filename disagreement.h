@@ -0,0 +1,48 @@
+#ifndef DISAGREEMENT_H
+#define DISAGREEMENT_H
+
+#include <vector>
+
+#include "opencv2/core.hpp"
+
+#include "layer.h"
+
+
+// Pixels where the prediction disagrees with the labels (ignoring unlabelled
+// pixels), recomputed only in the tiles either layer has changed since the
+// last update, and the connected regions of disagreement ranked by area.
+class Disagreement {
+
+public:
+    enum { tileSize = 256, minArea = 16 };
+
+    struct Region {
+        Region(cv::Rect const &rect, int area)
+            : rect(rect), area(area) {}
+
+        cv::Rect rect;
+        int area;
+    };
+
+    Disagreement();
+
+    // Bring up to date with the layers, true if the disagreement changed
+    bool update(Layer const &prediction, Layer const &labels, int ignore);
+    void reset();
+
+    // Regions of at least minArea pixels, largest first
+    std::vector<Region> const &regions();
+
+    cv::Mat1b const &mask() const { return diff; }
+
+private:
+    cv::Mat1b diff;
+    int ignore;
+
+    int predictionVersion, labelsVersion;
+
+    bool ranked;
+    std::vector<Region> ranking;
+};
+
+#endif // DISAGREEMENT_H
@@ -0,0 +1,186 @@
+#include "filmstrip.h"
+
+#include <QStyledItemDelegate>
+#include <QScrollBar>
+#include <QPainter>
+
+
+namespace {
+    int const margin = 4;
+    int const dotRadius = 5;
+
+
+    // Thumbnail above the name, with a dot in the corner for the status
+    class FilmstripDelegate : public QStyledItemDelegate {
+
+    public:
+        FilmstripDelegate(QObject *parent) : QStyledItemDelegate(parent) {}
+
+        QSize sizeHint(QStyleOptionViewItem const &option, QModelIndex const &) const {
+            return QSize(ThumbnailCache::size + 2 * margin, ThumbnailCache::size + option.fontMetrics.height() + 3 * margin);
+        }
+
+        void paint(QPainter *painter, QStyleOptionViewItem const &option, QModelIndex const &index) const {
+            QStyledItemDelegate::paint(painter, option, index);
+
+            int status = index.data(FilmstripModel::StatusRole).toInt();
+            if(!status)
+                return;
+
+            // annotated green, predicted only amber
+            QColor colour = status & ThumbnailCache::Annotated ? QColor(60, 180, 75) : QColor(245, 165, 35);
+            QRect dot(option.rect.right() - margin - 2 * dotRadius, option.rect.top() + margin, 2 * dotRadius, 2 * dotRadius);
+
+            painter->save();
+            painter->setRenderHint(QPainter::Antialiasing);
+            painter->setPen(Qt::black);
+            painter->setBrush(colour);
+            painter->drawEllipse(dot);
+            painter->restore();
+        }
+
+    protected:
+        void initStyleOption(QStyleOptionViewItem *option, QModelIndex const &index) const {
+            QStyledItemDelegate::initStyleOption(option, index);
+
+            option->decorationPosition = QStyleOptionViewItem::Top;
+            option->decorationAlignment = Qt::AlignCenter;
+            option->decorationSize = QSize(ThumbnailCache::size, ThumbnailCache::size);
+
+            option->displayAlignment = Qt::AlignHCenter | Qt::AlignBottom;
+            option->textElideMode = Qt::ElideMiddle;
+        }
+    };
+}
+
+
+FilmstripModel::FilmstripModel(QObject *parent)
+    : QAbstractListModel(parent), thumbnails(new ThumbnailCache(this)),
+      placeholder(ThumbnailCache::size, ThumbnailCache::size * 3 / 4) {
+
+    placeholder.fill(Qt::lightGray);
+    connect(thumbnails, &ThumbnailCache::ready, this, &FilmstripModel::thumbnailReady);
+}
+
+
+int FilmstripModel::rowCount(QModelIndex const &parent) const {
+    return parent.isValid() ? 0 : entries.size();
+}
+
+
+QVariant FilmstripModel::data(QModelIndex const &index, int role) const {
+    if(!index.isValid() || index.row() >= entries.size())
+        return QVariant();
+
+    QFileInfo const &e = entries[index.row()];
+
+    if(role == Qt::DisplayRole)
+        return e.fileName();
+
+    if(role != Qt::DecorationRole && role != Qt::ToolTipRole && role != StatusRole)
+        return QVariant();
+
+    // asked for as rows are drawn, so only those in view are made
+    ThumbnailCache::Thumbnail const *thumbnail = thumbnails->find(e.absoluteFilePath());
+
+    if(role == Qt::DecorationRole)
+        return thumbnail && !thumbnail->pixmap.isNull() ? thumbnail->pixmap : placeholder;
+
+    int status = thumbnail ? thumbnail->status : 0;
+    if(role == StatusRole)
+        return status;
+
+    QStringList notes;
+    if(status & ThumbnailCache::Annotated) notes << "annotated";
+    if(status & ThumbnailCache::Predicted) notes << "predicted";
+
+    return notes.isEmpty() ? e.fileName() : QString("%1 (%2)").arg(e.fileName(), notes.join(", "));
+}
+
+
+void FilmstripModel::setEntries(QFileInfoList const &entries_) {
+    beginResetModel();
+
+    entries = entries_;
+
+    rows.clear();
+    rows.reserve(entries.size());
+
+    for(int i = 0; i < entries.size(); ++i) {
+        rows.insert(entries[i].absoluteFilePath(), i);
+    }
+
+    endResetModel();
+}
+
+
+int FilmstripModel::indexOf(QFileInfo const &entry) const {
+    return rows.value(entry.absoluteFilePath(), -1);
+}
+
+
+void FilmstripModel::thumbnailReady(QString const &path) {
+    int row = rows.value(path, -1);
+
+    if(row >= 0) {
+        QModelIndex i = index(row);
+        emit dataChanged(i, i);
+    }
+}
+
+
+
+Filmstrip::Filmstrip(QWidget *parent)
+    : QListView(parent), model(new FilmstripModel(this)) {
+
+    setModel(model);
+    setItemDelegate(new FilmstripDelegate(this));
+
+    // one row, laid out without asking each item for its size
+    setFlow(QListView::LeftToRight);
+    setWrapping(false);
+    setUniformItemSizes(true);
+
+    setHorizontalScrollMode(QAbstractItemView::ScrollPerPixel);
+    setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    setSelectionMode(QAbstractItemView::SingleSelection);
+    setIconSize(QSize(ThumbnailCache::size, ThumbnailCache::size));
+
+    int height = ThumbnailCache::size + fontMetrics().height() + 3 * margin;
+    setFixedHeight(height + horizontalScrollBar()->sizeHint().height() + 2 * frameWidth());
+
+    connect(this, &QListView::clicked, [=] (QModelIndex const &index) {
+        emit chosen(model->entry(index.row()));
+    });
+}
+
+
+void Filmstrip::setEntries(QFileInfoList const &entries) {
+    model->setEntries(entries);
+}
+
+
+void Filmstrip::setCurrent(QFileInfo const &entry) {
+    int row = model->indexOf(entry);
+    if(row < 0)
+        return;
+
+    QModelIndex index = model->index(row);
+
+    setCurrentIndex(index);
+    scrollTo(index, QAbstractItemView::PositionAtCenter);
+}
+
+
+void Filmstrip::setColors(QVector<QRgb> const &palette) {
+    model->cache()->setColors(palette);
+    viewport()->update();
+}
+
+
+void Filmstrip::refresh(QFileInfo const &entry) {
+    model->cache()->refresh(entry.absoluteFilePath());
+
+    int row = model->indexOf(entry);
+    if(row >= 0) update(model->index(row));
+}
@@ -0,0 +1,71 @@
+#ifndef FILMSTRIP_H
+#define FILMSTRIP_H
+
+#include <QListView>
+#include <QAbstractListModel>
+#include <QFileInfo>
+#include <QHash>
+
+#include "thumbnails.h"
+
+
+// The images of a directory in order, as thumbnails made when they come into
+// view. Rows are only a file name until then, so a directory of any size
+// costs a list of names.
+class FilmstripModel : public QAbstractListModel {
+    Q_OBJECT
+
+public:
+    enum { StatusRole = Qt::UserRole };
+
+    FilmstripModel(QObject *parent = nullptr);
+
+    int rowCount(QModelIndex const &parent = QModelIndex()) const;
+    QVariant data(QModelIndex const &index, int role = Qt::DisplayRole) const;
+
+    void setEntries(QFileInfoList const &entries);
+    QFileInfo const &entry(int row) const { return entries[row]; }
+
+    // -1 if it isn't one of the entries
+    int indexOf(QFileInfo const &entry) const;
+
+    ThumbnailCache *cache() const { return thumbnails; }
+
+private:
+    void thumbnailReady(QString const &path);
+
+    QFileInfoList entries;
+    QHash<QString, int> rows;       // by absolute path
+
+    ThumbnailCache *thumbnails;
+    QPixmap placeholder;
+};
+
+
+// Strip of thumbnails of the images around the current one, uniformly sized
+// so only the rows in view are laid out and drawn.
+class Filmstrip : public QListView {
+    Q_OBJECT
+
+public:
+    Filmstrip(QWidget *parent = nullptr);
+
+    void setEntries(QFileInfoList const &entries);
+
+    // Selected and scrolled to the centre
+    void setCurrent(QFileInfo const &entry);
+
+    // Colours of the mask overlays
+    void setColors(QVector<QRgb> const &palette);
+
+    // After the image or its mask has been saved
+    void refresh(QFileInfo const &entry);
+
+signals:
+    void chosen(QFileInfo const &entry);
+
+private:
+    FilmstripModel *model;
+};
+
+#endif // FILMSTRIP_H
@@ -0,0 +1,73 @@
+#include "grabcut.h"
+
+#include <QtConcurrent>
+
+#include <opencv2/imgproc.hpp>
+
+
+GrabCut::GrabCut(QObject *parent)
+    : QObject(parent), generation(0) {
+    qRegisterMetaType<GrabCutResult>();
+}
+
+GrabCut::~GrabCut() {
+    cancel();
+    pool.waitForDone();
+}
+
+void GrabCut::cancel() {
+    ++generation;
+}
+
+
+int GrabCut::start(SourcePtr const &source, cv::Rect const &roi, cv::Mat1b const &seeds,
+                    cv::Rect const &selection, LayerPtr const &layer, int label) {
+    int id = ++generation;
+
+    QtConcurrent::run(&pool, [=] () {
+        cv::Mat4b pixels;
+        source->read(roi, pixels);
+
+        cv::Mat3b bgr;
+        cv::cvtColor(pixels, bgr, cv::COLOR_BGRA2BGR);
+
+        cv::Mat1b mask = seeds.clone();
+        cv::Mat bgModel, fgModel;
+
+        for(int i = 0; i < iterations; ++i) {
+            if(generation != id) return;
+
+            cv::grabCut(bgr, mask, cv::Rect(), bgModel, fgModel, 1, i == 0 ? cv::GC_INIT_WITH_MASK : cv::GC_EVAL);
+            emit progress(id, i + 1, iterations);
+        }
+
+        if(generation != id) return;
+
+        GrabCutResult result;
+        result.run = id;
+        result.layer = layer;
+        result.label = label;
+        result.selection = selection;
+
+        cv::Mat1b m = mask(selection - roi.tl());
+        result.foreground = (m == cv::GC_FGD) | (m == cv::GC_PR_FGD);
+
+        emit finished(result);
+    });
+
+    return id;
+}
+
+
+cv::Mat1b grabCutSeeds(LabelMat const &active, int activeDefault, LabelMat const &base, int label) {
+    cv::Mat1b seeds(active.size(), uint8_t(cv::GC_PR_BGD));
+
+    if(!base.empty()) {
+        seeds.setTo(cv::GC_PR_FGD, base == label);
+    }
+
+    seeds.setTo(cv::GC_BGD, (active != label) & (active != activeDefault));
+    seeds.setTo(cv::GC_FGD, active == label);
+
+    return seeds;
+}
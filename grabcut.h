@@ -0,0 +1,64 @@
+#ifndef GRABCUT_H
+#define GRABCUT_H
+
+#include <QObject>
+#include <QThreadPool>
+
+#include <atomic>
+
+#include "opencv2/core.hpp"
+
+#include "source.h"
+#include "layer.h"
+
+
+// Foreground found by a GrabCut run, to be merged into layer as label
+struct GrabCutResult {
+    GrabCutResult() : run(0), label(0) {}
+
+    int run;
+
+    LayerPtr layer;
+    int label;
+
+    cv::Rect selection;
+    cv::Mat1b foreground;   // of selection
+};
+
+Q_DECLARE_METATYPE(GrabCutResult)
+
+
+// GrabCut of a region of the image on a worker thread, one iteration at a
+// time so it can report progress and be cancelled between iterations.
+class GrabCut : public QObject {
+    Q_OBJECT
+
+public:
+    enum { iterations = 5, margin = 32 };
+
+    GrabCut(QObject *parent = nullptr);
+    ~GrabCut();
+
+    // seeds are GC_* values for roi, which contains selection. The result
+    // is reported for selection only, the rest of roi is context.
+    int start(SourcePtr const &source, cv::Rect const &roi, cv::Mat1b const &seeds,
+               cv::Rect const &selection, LayerPtr const &layer, int label);
+
+    void cancel();
+    int currentRun() const { return generation; }
+
+signals:
+    void progress(int run, int iteration, int total);
+    void finished(GrabCutResult const &result);
+
+private:
+    std::atomic<int> generation;
+    QThreadPool pool;       // of every run, a cancelled one finishes its iteration
+};
+
+
+// GrabCut seeds for roi: pixels of active labelled label are foreground,
+// other labels background, and pixels base predicts as label probably foreground
+cv::Mat1b grabCutSeeds(LabelMat const &active, int activeDefault, LabelMat const &base, int label);
+
+#endif // GRABCUT_H
@@ -0,0 +1,348 @@
+#include "kernels.h"
+
+#include <cstring>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+void packPixels(uint32_t const *src, uint8_t const *overlay, int weight, uint32_t *dst, int n) {
+
+    if(!overlay) {
+        std::memcpy(dst, src, n * sizeof(uint32_t));
+        return;
+    }
+
+    int i = 0;
+
+#ifdef __SSE2__
+    for(; i + 4 <= n; i += 4) {
+        // darkening of each pixel in its R, G and B bytes
+        uint32_t v[4];
+        for(int k = 0; k < 4; ++k) {
+            v[k] = ((overlay[i + k] * weight) >> 8) * 0x010101;
+        }
+
+        __m128i p = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+        __m128i d = _mm_set_epi32(v[3], v[2], v[1], v[0]);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_subs_epu8(p, d));
+    }
+#endif
+
+    for(; i < n; ++i) {
+        int v = (overlay[i] * weight) >> 8;
+        uint32_t p = src[i];
+
+        int r = std::max<int>(0, ((p >> 16) & 0xff) - v);
+        int g = std::max<int>(0, ((p >> 8) & 0xff) - v);
+        int b = std::max<int>(0, (p & 0xff) - v);
+
+        dst[i] = 0xff000000 | (r << 16) | (g << 8) | b;
+    }
+}
+
+
+inline uint32_t blendPixel(uint32_t d, uint32_t pre, unsigned inv) {
+    uint32_t r = (((d >> 16) & 0xff) * inv) >> 8;
+    uint32_t g = (((d >> 8) & 0xff) * inv) >> 8;
+    uint32_t b = ((d & 0xff) * inv) >> 8;
+
+    return 0xff000000 | (((r << 16) | (g << 8) | b) + pre);
+}
+
+
+// Both label types, the lut is looked up one label at a time
+template<typename T>
+inline void blendRow(T const *labels, BlendLut_<T> const &lut, uint32_t *dst, int n) {
+    int i = 0;
+
+#ifdef __SSE2__
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const opaque = _mm_set1_epi32(0xff000000);
+
+    for(; i + 4 <= n; i += 4) {
+        T l0 = labels[i], l1 = labels[i + 1], l2 = labels[i + 2], l3 = labels[i + 3];
+        short i0 = lut.inv[l0], i1 = lut.inv[l1], i2 = lut.inv[l2], i3 = lut.inv[l3];
+
+        // all four transparent
+        if((i0 & i1 & i2 & i3) == 256)
+            continue;
+
+        __m128i d = _mm_loadu_si128(reinterpret_cast<__m128i const*>(dst + i));
+
+        __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_set_epi16(i1, i1, i1, i1, i0, i0, i0, i0));
+        __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_set_epi16(i3, i3, i3, i3, i2, i2, i2, i2));
+
+        __m128i r = _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+        __m128i pre = _mm_set_epi32(lut.pre[l3], lut.pre[l2], lut.pre[l1], lut.pre[l0]);
+
+        r = _mm_or_si128(_mm_add_epi8(r, pre), opaque);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), r);
+    }
+#endif
+
+    for(; i < n; ++i) {
+        T l = labels[i];
+        dst[i] = blendPixel(dst[i], lut.pre[l], lut.inv[l]);
+    }
+}
+
+void blendLabels(uint8_t const *labels, BlendLut_<uint8_t> const &lut, uint32_t *dst, int n) {
+    blendRow(labels, lut, dst, n);
+}
+
+void blendLabels(uint16_t const *labels, BlendLut_<uint16_t> const &lut, uint32_t *dst, int n) {
+    blendRow(labels, lut, dst, n);
+}
+
+
+void blendSolid(uint32_t pre, unsigned inv, uint32_t *dst, int n) {
+    int i = 0;
+
+#ifdef __SSE2__
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const opaque = _mm_set1_epi32(0xff000000);
+
+    __m128i const scale = _mm_set1_epi16(short(inv));
+    __m128i const colour = _mm_set1_epi32(pre);
+
+    for(; i + 4 <= n; i += 4) {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<__m128i const*>(dst + i));
+
+        __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), scale);
+        __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), scale);
+
+        __m128i r = _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_or_si128(_mm_add_epi8(r, colour), opaque));
+    }
+#endif
+
+    for(; i < n; ++i) {
+        dst[i] = blendPixel(dst[i], pre, inv);
+    }
+}
+
+
+void argmaxLabels(uint8_t const *const *probs, int const *bias, int classes,
+                  int threshold, int reject, uint8_t *dst, int n) {
+    int i = 0;
+
+#ifdef __SSE2__
+    __m128i const limit = _mm_set1_epi8(char(threshold));
+    __m128i const rejected = _mm_set1_epi8(char(reject));
+
+    for(; i + 16 <= n; i += 16) {
+        __m128i best = _mm_setzero_si128();
+        __m128i label = _mm_setzero_si128();
+
+        for(int c = 0; c < classes; ++c) {
+            __m128i p = _mm_loadu_si128(reinterpret_cast<__m128i const*>(probs[c] + i));
+            p = _mm_adds_epu8(p, _mm_set1_epi8(char(std::max(0, std::min(255, bias[c])))));
+            p = _mm_subs_epu8(p, _mm_set1_epi8(char(std::max(0, std::min(255, -bias[c])))));
+
+            // p > best, as unsigned bytes
+            __m128i greater = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_max_epu8(p, best), best), _mm_set1_epi8(-1));
+            if(c == 0) greater = _mm_set1_epi8(-1);
+
+            best = _mm_max_epu8(p, best);
+            label = _mm_or_si128(_mm_and_si128(greater, _mm_set1_epi8(char(c))), _mm_andnot_si128(greater, label));
+        }
+
+        __m128i confident = _mm_cmpeq_epi8(_mm_max_epu8(best, limit), best);
+        __m128i r = _mm_or_si128(_mm_and_si128(confident, label), _mm_andnot_si128(confident, rejected));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), r);
+    }
+#endif
+
+    for(; i < n; ++i) {
+        int best = -1, label = 0;
+
+        for(int c = 0; c < classes; ++c) {
+            int p = std::max(0, std::min(255, probs[c][i] + bias[c]));
+
+            if(p > best) {
+                best = p;
+                label = c;
+            }
+        }
+
+        dst[i] = best >= threshold ? label : reject;
+    }
+}
+
+void argmaxLabels(uint8_t const *const *probs, int const *bias, int classes,
+                  int threshold, int reject, uint16_t *dst, int n) {
+    std::vector<uint8_t> labels(n);
+
+    // one byte per label is enough for the first 256 classes
+    if(classes <= 256 && reject < 256) {
+        argmaxLabels(probs, bias, classes, threshold, reject, labels.data(), n);
+        std::copy(labels.begin(), labels.end(), dst);
+        return;
+    }
+
+    for(int i = 0; i < n; ++i) {
+        int best = -1, label = 0;
+
+        for(int c = 0; c < classes; ++c) {
+            int p = std::max(0, std::min(255, probs[c][i] + bias[c]));
+
+            if(p > best) {
+                best = p;
+                label = c;
+            }
+        }
+
+        dst[i] = best >= threshold ? label : reject;
+    }
+}
+
+
+void colourMatch(uint32_t const *pixels, uint32_t colour, int tolerance, uint8_t *dst, int n) {
+    int i = 0;
+
+#ifdef __SSE2__
+    __m128i const c = _mm_set1_epi32(colour);
+    __m128i const limit = _mm_set1_epi8(char(tolerance));
+    __m128i const rgb = _mm_set1_epi32(0x00ffffff);
+    __m128i const zero = _mm_setzero_si128();
+
+    for(; i + 4 <= n; i += 4) {
+        __m128i p = _mm_loadu_si128(reinterpret_cast<__m128i const*>(pixels + i));
+        __m128i d = _mm_or_si128(_mm_subs_epu8(p, c), _mm_subs_epu8(c, p));
+
+        // any channel over the limit
+        __m128i over = _mm_and_si128(_mm_subs_epu8(d, limit), rgb);
+        __m128i match = _mm_cmpeq_epi32(over, zero);
+
+        match = _mm_packs_epi32(match, match);
+        match = _mm_packs_epi16(match, match);
+
+        int m = _mm_cvtsi128_si32(match);
+        std::memcpy(dst + i, &m, 4);
+    }
+#endif
+
+    for(; i < n; ++i) {
+        uint32_t p = pixels[i];
+        bool match = true;
+
+        for(int shift = 0; shift < 24; shift += 8) {
+            int d = int((p >> shift) & 0xff) - int((colour >> shift) & 0xff);
+            match = match && std::abs(d) <= tolerance;
+        }
+
+        dst[i] = match ? 255 : 0;
+    }
+}
+
+
+void diffLabels(uint8_t const *a, uint8_t const *b, int ignore, uint8_t *dst, int n) {
+    int i = 0;
+
+#ifdef __SSE2__
+    __m128i const ignored = _mm_set1_epi8(char(ignore));
+    __m128i const ones = _mm_set1_epi8(-1);
+
+    for(; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<__m128i const*>(b + i));
+
+        __m128i labelled = _mm_andnot_si128(_mm_cmpeq_epi8(y, ignored), ones);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_andnot_si128(_mm_cmpeq_epi8(x, y), labelled));
+    }
+#endif
+
+    for(; i < n; ++i) {
+        dst[i] = (a[i] != b[i] && b[i] != ignore) ? 255 : 0;
+    }
+}
+
+void diffLabels(uint16_t const *a, uint16_t const *b, int ignore, uint8_t *dst, int n) {
+    int i = 0;
+
+#ifdef __SSE2__
+    __m128i const ignored = _mm_set1_epi16(short(ignore));
+    __m128i const ones = _mm_set1_epi16(-1);
+
+    for(; i + 16 <= n; i += 16) {
+        __m128i x0 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(a + i));
+        __m128i x1 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(a + i + 8));
+        __m128i y0 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(b + i));
+        __m128i y1 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(b + i + 8));
+
+        __m128i d0 = _mm_andnot_si128(_mm_cmpeq_epi16(x0, y0), _mm_andnot_si128(_mm_cmpeq_epi16(y0, ignored), ones));
+        __m128i d1 = _mm_andnot_si128(_mm_cmpeq_epi16(x1, y1), _mm_andnot_si128(_mm_cmpeq_epi16(y1, ignored), ones));
+
+        // 0 or -1 in each word, saturates to 0 or 255 bytes
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi16(d0, d1));
+    }
+#endif
+
+    for(; i < n; ++i) {
+        dst[i] = (a[i] != b[i] && b[i] != ignore) ? 255 : 0;
+    }
+}
+
+
+void gatherLabels(uint8_t const *src, int const *index, uint8_t *dst, int n) {
+    for(int i = 0; i < n; ++i) {
+        dst[i] = src[index[i]];
+    }
+}
+
+void gatherLabels(uint16_t const *src, int const *index, uint16_t *dst, int n) {
+    for(int i = 0; i < n; ++i) {
+        dst[i] = src[index[i]];
+    }
+}
+
+
+int runLength(uint8_t const *p, int n) {
+    uint8_t v = p[0];
+    int i = 1;
+
+#ifdef __SSE2__
+    __m128i const value = _mm_set1_epi8(v);
+
+    for(; i + 16 <= n; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i));
+        int equal = _mm_movemask_epi8(_mm_cmpeq_epi8(block, value));
+
+        if(equal != 0xffff) {
+            return i + __builtin_ctz(~equal);
+        }
+    }
+#endif
+
+    for(; i < n && p[i] == v; ++i) {}
+    return i;
+}
+
+int runLength(uint16_t const *p, int n) {
+    uint16_t v = p[0];
+    int i = 1;
+
+#ifdef __SSE2__
+    __m128i const value = _mm_set1_epi16(short(v));
+
+    for(; i + 8 <= n; i += 8) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i));
+        int equal = _mm_movemask_epi8(_mm_cmpeq_epi16(block, value));
+
+        // two mask bits per value
+        if(equal != 0xffff) {
+            return i + __builtin_ctz(~equal) / 2;
+        }
+    }
+#endif
+
+    for(; i < n && p[i] == v; ++i) {}
+    return i;
+}
@@ -0,0 +1,53 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstdint>
+
+#include "labels.h"
+
+// Row kernels on plain pointers, so they don't care where the rows came from.
+// SSE2 where available with a scalar tail. Those on labels come in 8 and 16
+// bit versions.
+
+
+// Premultiplied colour and inverse alpha (0-256) for each label
+template<typename T> struct BlendLut_ {
+    uint32_t pre[LabelRange<T>::count];
+    uint16_t inv[LabelRange<T>::count];
+};
+
+typedef BlendLut_<label_t> BlendLut;
+
+
+// Copy a row of 0xffRRGGBB pixels, darkened by overlay * weight / 256 (overlay may be null)
+void packPixels(uint32_t const *src, uint8_t const *overlay, int weight, uint32_t *dst, int n);
+
+// dst = lut.pre[label] + dst * lut.inv[label] / 256
+void blendLabels(uint8_t const *labels, BlendLut_<uint8_t> const &lut, uint32_t *dst, int n);
+void blendLabels(uint16_t const *labels, BlendLut_<uint16_t> const &lut, uint32_t *dst, int n);
+
+// blendLabels for a row of a single label
+void blendSolid(uint32_t pre, unsigned inv, uint32_t *dst, int n);
+
+// Index of the largest probs[c][i] + bias[c] (clamped to 0-255, first on ties),
+// or reject where that is below threshold
+void argmaxLabels(uint8_t const *const *probs, int const *bias, int classes,
+                  int threshold, int reject, uint8_t *dst, int n);
+void argmaxLabels(uint8_t const *const *probs, int const *bias, int classes,
+                  int threshold, int reject, uint16_t *dst, int n);
+
+// 255 where no channel of a 0xffRRGGBB pixel differs from colour by more than tolerance, otherwise 0
+void colourMatch(uint32_t const *pixels, uint32_t colour, int tolerance, uint8_t *dst, int n);
+
+// 255 where a and b differ and b is not ignore, otherwise 0
+void diffLabels(uint8_t const *a, uint8_t const *b, int ignore, uint8_t *dst, int n);
+void diffLabels(uint16_t const *a, uint16_t const *b, int ignore, uint8_t *dst, int n);
+
+void gatherLabels(uint8_t const *src, int const *index, uint8_t *dst, int n);
+void gatherLabels(uint16_t const *src, int const *index, uint16_t *dst, int n);
+
+// Number of leading values equal to p[0] (n > 0)
+int runLength(uint8_t const *p, int n);
+int runLength(uint16_t const *p, int n);
+
+#endif // KERNELS_H
@@ -0,0 +1,28 @@
+#ifndef LABELS_H
+#define LABELS_H
+
+#include <cstdint>
+
+#include "opencv2/core.hpp"
+
+
+// Layers and masks are templates on the type of their labels, the one used is
+// chosen at build time: 8 bit by default (up to 255 classes and ignore), 16 bit
+// with CONFIG += labels16 for larger taxonomies.
+#ifdef LABELS_16
+typedef uint16_t label_t;
+#else
+typedef uint8_t label_t;
+#endif
+
+typedef cv::Mat_<label_t> LabelMat;
+
+
+// Number of distinct values of a label type
+template<typename T> struct LabelRange {
+    enum { count = 1 << (8 * sizeof(T)) };
+};
+
+static int const labelCount = LabelRange<label_t>::count;
+
+#endif // LABELS_H
@@ -1,49 +1,162 @@
 #include "layer.h"
+#include "raster.h"
+#include "rle.h"
+#include "tiles.h"
+#include "kernels.h"
 #include <set>
 
 
 
-QPixmap const& Layer::getPixmap() {
+template<typename T>
+void Layer_<T>::setMask(Labels const& indices) {
+    setMask(compactMask(indices));
+}
+
+template<typename T>
+void Layer_<T>::setMask(MaskPtr const &m) {
+    mask = m;
+    recount();
+
+    if(marks) marks = findMarks();
+    changed(cv::Rect(cv::Point(), size()));
+}
 
-    if(dirty) {
+template<typename T>
+void Layer_<T>::reset(int rows, int cols) {
+    mask = std::make_shared<TileMask_<T>>(rows, cols, default_label);
+
+    std::fill(counts.begin(), counts.end(), 0);
+    counts[default_label] = int64_t(rows) * cols;
+
+    if(marks) marks = std::make_shared<TileMask_<T>>(rows, cols, 0);
+    changed(cv::Rect(cv::Point(), size()));
+}
 
-        QImage indexMask(image.data, image.cols, image.rows, QImage::Format_Indexed8);
-        indexMask.setColorTable(palette);
 
-        pixmap = QPixmap::fromImage(indexMask);
+template<typename T>
+void Layer_<T>::edited(cv::Rect const &r) {
+    // runs which have become too fragmented are cheaper stored as tiles
+    if(mask->bytes() > 2 * size_t(mask->rows) * mask->cols) {
+        mask = std::make_shared<TileMask_<T>>(*mask);
     }
 
-    return pixmap;
+    changed(r);
+}
+
+template<typename T>
+void Layer_<T>::changed(cv::Rect const &r) {
+    ++version;
 
+    changes.push_back(std::make_pair(version, r));
+    if(changes.size() > size_t(maxChanges)) changes.pop_front();
 }
 
+template<typename T>
+void Layer_<T>::fillSpan(int y, int x0, int x1, int label) {
+    // drawn over, even with the label which was there
+    if(marks) marks->fillSpan(y, x0, x1, label != default_label);
+
+    int current;
+    if(mask->uniform(y, x0, x1, current)) {
+        if(current == label)
+            return;
+
+        counts[current] -= x1 - x0;
+    } else {
+        count(cv::Rect(x0, y, x1 - x0, 1), -1);
+    }
+
+    counts[label] += x1 - x0;
 
-float length(cv::Point2f const &p) {
-    return std::sqrt(p.dot(p));
+    mask->fillSpan(y, x0, x1, label);
 }
 
+template<typename T>
+void Layer_<T>::count(cv::Rect const &r, int sign) {
+    std::vector<T> buffer(r.width);
 
-inline cv::Point2f perpLine(cv::Point2f const &start, cv::Point2f const &end) {
-    cv::Point2f line = end - start;
-    cv::Point2f dir = line / length(line);
+    for(int y = r.y; y < r.y + r.height; ++y) {
+        int label;
+        if(mask->uniform(y, r.x, r.x + r.width, label)) {
+            counts[label] += sign * r.width;
+            continue;
+        }
 
-    return cv::Point2f (dir.y, -dir.x);
+        T const *labels = mask->row(y, r.x, r.x + r.width, buffer.data());
+        for(int x = 0; x < r.width; ) {
+            int n = runLength(labels + x, r.width - x);
+            counts[labels[x]] += sign * n;
+            x += n;
+        }
+    }
 }
 
+template<typename T>
+void Layer_<T>::count(Labels const &labels, int sign) {
+    for(int y = 0; y < labels.rows; ++y) {
+        T const *row = labels.template ptr<T>(y);
 
-inline std::vector<cv::Point2f> makeRect(Point const &p1, Point const p2) {
-    cv::Point2f perp = perpLine(p1.p, p2.p);
-    return std::vector<cv::Point2f> {p1.p + perp * p1.r, p2.p + perp * p2.r, p2.p - perp * p2.r, p1.p - perp * p1.r};
+        for(int x = 0; x < labels.cols; ) {
+            int n = runLength(row + x, labels.cols - x);
+            counts[row[x]] += sign * n;
+            x += n;
+        }
+    }
 }
 
-void Layer::drawPoint(Point const &p, int label) {
-    cv::Scalar c(label, label, label);
-    cv::circle(image, cv::Point(p.p.x, p.p.y), p.r, c, -1);
+template<typename T>
+void Layer_<T>::recount() {
+    std::fill(counts.begin(), counts.end(), 0);
+    if(mask) count(cv::Rect(cv::Point(), size()), 1);
+}
+
+
+template<typename T>
+cv::Rect Layer_<T>::changedSince(int since) const {
+    cv::Rect all(cv::Point(), size());
+
+    if(since == version)
+        return cv::Rect();
+
+    if(changes.empty() || changes.front().first > since + 1)
+        return all;
+
+    cv::Rect r;
+    for(auto const &c : changes) {
+        if(c.first <= since || c.second.area() == 0)
+            continue;
 
-    dirty = true;
+        r = r.area() ? (r | c.second) : c.second;
+    }
+
+    return r & all;
+}
+
+template<typename T>
+void Layer_<T>::drawPoint(Point const &p, int label) {
+    drawStroke(std::vector<Point> {p}, label);
 }
 
-void Layer::drawPoly(std::vector<cv::Point2f> const &points, int label) {
+template<typename T>
+void Layer_<T>::drawStroke(std::vector<Point> const &points, int label) {
+    Spans spans = strokeSpans(points, size());
+    if(spans.empty())
+        return;
+
+    int x0 = size().width, x1 = 0;
+    for(auto const &s : spans) {
+        fillSpan(s.y, s.x0, s.x1, label);
+
+        x0 = std::min(x0, s.x0);
+        x1 = std::max(x1, s.x1);
+    }
+
+    // merged spans are sorted by row
+    edited(cv::Rect(x0, spans.front().y, x1 - x0, spans.back().y + 1 - spans.front().y));
+}
+
+template<typename T>
+void Layer_<T>::drawPoly(std::vector<cv::Point2f> const &points, int label) {
     cv::Scalar c(label, label, label);
 
     std::vector<cv::Point> ps;
@@ -51,13 +164,33 @@ void Layer::drawPoly(std::vector<cv::Point2f> const &points, int label) {
         ps.push_back(p);
     }
 
+    cv::Rect roi = cv::boundingRect(ps) & cv::Rect(cv::Point(0, 0), size());
+    if(roi.area() == 0)
+        return;
+
+    Labels region;
+    mask->read(roi, region);
+    count(region, -1);
 
     std::vector<std::vector<cv::Point>> pts = {ps};
-    cv::fillPoly(image, pts, c);
+    cv::fillPoly(region, pts, c, cv::LINE_8, 0, -roi.tl());
+
+    count(region, 1);
+    mask->write(roi, region);
+
+    if(marks) {
+        Labels marked;
+        marks->read(roi, marked);
 
+        cv::fillPoly(marked, pts, cv::Scalar(label != default_label), cv::LINE_8, 0, -roi.tl());
+        marks->write(roi, marked);
+    }
+
+    edited(roi);
 }
 
-void Layer::drawSP(cv::Mat1i const& spLabels, Point const &p, int label) {
+template<typename T>
+void Layer_<T>::drawSP(cv::Mat1i const& spLabels, Point const &p, int label) {
 
     cv::Point c = p.p;
     int r = p.r;
@@ -77,45 +210,196 @@ void Layer::drawSP(cv::Mat1i const& spLabels, Point const &p, int label) {
         }
     }
 
+    if(labels.empty())
+        return;
 
-
+    std::vector<bool> selected(*labels.rbegin() + 1, false);
     for (int l : labels) {
-        cv::Mat1b mask = spLabels == l;
-        image.setTo(label, mask);
+        selected[l] = true;
+    }
+
+    auto inside = [&](int l) {
+        return l >= 0 && l < int(selected.size()) && selected[l];
+    };
+
+    for(int y = 0; y < spLabels.rows; ++y) {
+        int const *row = spLabels.ptr<int>(y);
+
+        for(int x = 0; x < spLabels.cols; ) {
+            if(!inside(row[x])) {
+                ++x;
+                continue;
+            }
+
+            int start = x;
+            while(x < spLabels.cols && inside(row[x])) ++x;
+
+            fillSpan(y, start, x, label);
+        }
     }
 
-    dirty = true;
+    edited(cv::Rect(cv::Point(), size()));
 }
 
 
-void Layer::drawLine(Point const &start, Point const& end, int label) {
-    std::vector<cv::Point2f> rect = makeRect(start, end);
-    std::vector<cv::Point> points(rect.begin(), rect.end());
+template<typename T>
+void Layer_<T>::drawLine(Point const &start, Point const& end, int label) {
+    drawStroke(std::vector<Point> {start, end}, label);
+}
 
-    cv::Scalar c(label, label, label);
-    cv::fillConvexPoly(image, points, c);
 
-    drawPoint(start, label);
-    drawPoint(end, label);
+template<typename T>
+void Layer_<T>::floodFill(Point const &p, int label) {
+    cv::Point seed(p.p.x, p.p.y);
+    if(!cv::Rect(cv::Point(), size()).contains(seed))
+        return;
+
+    // everything filled was the label under the seed
+    int target = mask->at(seed.x, seed.y);
+
+    cv::Rect r;
+    int area = mask->floodFill(seed, label, &r);
+
+    counts[target] -= area;
+    counts[label] += area;
+
+    // what was filled is in the component of label at the seed, which
+    // also takes in any filled in pixels of label that it touches
+    if(marks && area > 0) {
+        Labels region, marked;
+        mask->read(r, region);
+        marks->read(r, marked);
+
+        cv::Mat1b component = region == label;
+        cv::floodFill(component, seed - r.tl(), cv::Scalar(2));
+
+        int mark = label != default_label;
+        for(int y = 0; y < r.height; ++y) {
+            for(int x = 0; x < r.width; ++x) {
+                if(component(y, x) == 2) marked(y, x) = mark;
+            }
+        }
+
+        marks->write(r, marked);
+    }
+
+    edited(r);
 }
 
+template<typename T>
+void Layer_<T>::fillSpans(Spans const &spans, int label) {
+    if(spans.empty())
+        return;
 
-void Layer::floodFill(Point const &p, int label) {
-    cv::Scalar c(label, label, label);
-    cv::floodFill(image, cv::Point(p.p.x, p.p.y), c);
+    int x0 = size().width, x1 = 0, y0 = size().height, y1 = 0;
+    for(auto const &s : spans) {
+        fillSpan(s.y, s.x0, s.x1, label);
+
+        x0 = std::min(x0, s.x0);
+        x1 = std::max(x1, s.x1);
+        y0 = std::min(y0, s.y);
+        y1 = std::max(y1, s.y + 1);
+    }
+
+    edited(cv::Rect(x0, y0, x1 - x0, y1 - y0));
+}
+
+template<typename T>
+void Layer_<T>::setRegion(cv::Rect const &r, Labels const &labels) {
+    if(marks) {
+        Labels current, marked;
+        mask->read(r, current);
+        marks->read(r, marked);
+
+        for(int y = 0; y < r.height; ++y) {
+            for(int x = 0; x < r.width; ++x) {
+                if(labels(y, x) != current(y, x)) marked(y, x) = labels(y, x) != default_label;
+            }
+        }
+
+        marks->write(r, marked);
+    }
+
+    fillRegion(r, labels);
+}
+
+template<typename T>
+void Layer_<T>::fillRegion(cv::Rect const &r, Labels const &labels) {
+    count(r, -1);
+    count(labels, 1);
 
-    dirty = true;
+    mask->write(r, labels);
+    edited(r);
 }
 
 
 
-void Layer::drawRect(cv::Rect2f const &s, int label) {
-    image(s) = label;
+template<typename T>
+void Layer_<T>::drawRect(cv::Rect2f const &s, int label) {
+    cv::Rect r = cv::Rect(s) & cv::Rect(cv::Point(0, 0), size());
+
+    count(r, -1);
+    counts[label] += r.area();
+
+    mask->fillRect(r, label);
+    if(marks) marks->fillRect(r, label != default_label);
 
-    dirty = true;
+    edited(r);
 }
 
 
+template<typename T>
+void Layer_<T>::setMarking(bool on) {
+    if(on == isMarking())
+        return;
+
+    marks = on && mask ? findMarks() : MaskPtr();
+}
+
+template<typename T>
+typename Layer_<T>::MaskPtr Layer_<T>::findMarks() const {
+    cv::Size s = size();
+    auto found = std::make_shared<TileMask_<T>>(s.height, s.width, 0);
+
+    std::vector<T> buffer(s.width);
+
+    for(int y = 0; y < s.height; ++y) {
+        int label;
+        if(mask->uniform(y, 0, s.width, label)) {
+            if(label != default_label) found->fillSpan(y, 0, s.width, 1);
+            continue;
+        }
+
+        T const *labels = mask->row(y, 0, s.width, buffer.data());
+        for(int x = 0; x < s.width; ) {
+            int n = runLength(labels + x, s.width - x);
+            if(labels[x] != default_label) found->fillSpan(y, x, x + n, 1);
+
+            x += n;
+        }
+    }
+
+    return found;
+}
+
+template<typename T>
+typename Layer_<T>::Labels Layer_<T>::getMarks(cv::Rect const &r) const {
+    Labels marked;
+    if(marks) marks->read(r, marked);
+
+    return marked;
+}
+
+template<typename T>
+void Layer_<T>::setMarks(cv::Rect const &r, Labels const &m) {
+    if(marks) marks->write(r, m);
+}
+
+
+
+template class Layer_<uint8_t>;
+template class Layer_<uint16_t>;
+
 
 QVector<QRgb> makeColorTable() {
 
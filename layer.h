@@ -8,19 +8,27 @@
 #include <QImage>
 #include <QRgb>
 
+#include <deque>
+#include <vector>
+
 #include "opencv2/core.hpp"
 #include <opencv2/imgproc.hpp>
 #include "state.h"
+#include "mask.h"
+#include "raster.h"
 
 QVector<QRgb> makeColorTable();
 
 
-class Layer {
+template<typename T>
+class Layer_ {
 
 public:
+    typedef cv::Mat_<T> Labels;
+    typedef typename MaskStore_<T>::Ptr MaskPtr;
 
-    Layer(int default_label=0) :
-       dirty(false), default_label(default_label), opacity(30)
+    Layer_(int default_label=0) :
+       counts(LabelRange<T>::count, 0), default_label(default_label), opacity(30), outlined(false), version(0)
     {
         palette = makeColorTable();
     }
@@ -29,30 +37,58 @@ public:
         default_label = label;
     }
 
+    int getDefaultLabel() const { return default_label; }
+
+
+    // Masks which are mostly flat are run length encoded, others kept as they are
+    void setMask(Labels const& indices);
+
+    // Takes the store as it is, e.g. labels mapped from a raw mask
+    void setMask(MaskPtr const &m);
+
+    // Dense labels, shared with the layer if it is stored densely
+    Labels getMask() const {
+        return mask ? mask->dense() : Labels();
+    }
+
+    T const *row(int y, int x0, int x1, T *buffer) const {
+        return mask->row(y, x0, x1, buffer);
+    }
+
+    bool uniform(int y, int x0, int x1, int &label) const {
+        return mask->uniform(y, x0, x1, label);
+    }
 
-    void setMask(cv::Mat1b const& indices) {
-        image = indices;
+    cv::Size size() const {
+        return mask ? mask->size() : cv::Size();
     }
 
-    cv::Mat1b const &getMask() const {
-        return image;
+    void reset(int rows, int cols);
+
+
+    // Compact copy of the labels for undo
+    MaskPtr snapshot() const {
+        return mask ? mask->snapshot() : MaskPtr();
     }
 
-    void reset(int rows, int cols) {
-        image = cv::Mat1b(rows, cols);
-        image = default_label;
+    // With the marks of the snapshot, or all labelled pixels marked if there are none
+    void restore(MaskPtr const &m, MaskPtr const &marked = MaskPtr()) {
+        mask = m ? m->clone() : MaskPtr();
+        recount();
 
-        dirty = true;
+        if(marks) marks = marked ? marked->clone() : findMarks();
+        changed(cv::Rect(cv::Point(), size()));
     }
 
 
     void setPalette(QVector<QRgb> const &palette_) {
         palette = palette_;
-        dirty = true;
-
+        changed(cv::Rect());
     }
 
-    QPixmap const& getPixmap();
+    QVector<QRgb> const &getPalette() const {
+        return palette;
+    }
 
     QColor getColor(int label) {
         label = std::min<int>(label, palette.size());
@@ -61,12 +97,28 @@ public:
 
 
     void drawPoint(Point const &p, int label);
+    void drawStroke(std::vector<Point> const &points, int label);
     void drawPoly(std::vector<cv::Point2f> const &points, int label);
     void drawSP(cv::Mat1i const& spLabels, Point const &p, int label);
 
     void drawLine(Point const &start, Point const& end, int label);
 
     void floodFill(Point const &p, int label);
+
+    // Exactly these pixels, e.g. the spans of a component
+    void fillSpans(Spans const &spans, int label);
+
+    Labels getRegion(cv::Rect const &r) const {
+        Labels labels;
+        mask->read(r, labels);
+        return labels;
+    }
+
+    // Replace the labels of r, e.g. with predictions. Pixels whose label changes are marked.
+    void setRegion(cv::Rect const &r, Labels const &labels);
+
+    // Labels filled in around the marked pixels, e.g. by a watershed, marks are kept
+    void fillRegion(cv::Rect const &r, Labels const &labels);
     void drawRect(cv::Rect2f const &s, int label);
 
     void clearRect(cv::Rect2f const &s) {
@@ -79,20 +131,74 @@ public:
 
     int getOpacity() const { return opacity; }
 
+    // Draw only the boundaries between labels (opaque), not the labels
+    void setOutlined(bool outlined_) {
+        outlined = outlined_;
+    }
+
+    bool isOutlined() const { return outlined; }
+
+    // Pixels of each label, kept up to date by the edits
+    int64_t getCount(int label) const { return counts[label]; }
+    std::vector<int64_t> const &getCounts() const { return counts; }
+
+    // Pixels labelled by an edit rather than filled in, kept while marking is on.
+    // Turning it on marks every pixel not of the default label.
+    void setMarking(bool on);
+    bool isMarking() const { return bool(marks); }
+
+    // 1 where marked, empty unless marking
+    Labels getMarks(cv::Rect const &r) const;
+    void setMarks(cv::Rect const &r, Labels const &m);
+
+    MaskPtr snapshotMarks() const {
+        return marks ? marks->snapshot() : MaskPtr();
+    }
+
+    // Incremented on every change to the mask or palette
+    int getVersion() const { return version; }
+
+    // Bounds of the labels changed after version, all of the
+    // layer if the changes go back further than those kept
+    cv::Rect changedSince(int version) const;
+
 private:
 
-    QPixmap pixmap;
-    cv::Mat1b image;
+    enum { maxChanges = 64 };
+
+    void edited(cv::Rect const &r);
+    void changed(cv::Rect const &r);
+
+    // Span of one label, counted and marked
+    void fillSpan(int y, int x0, int x1, int label);
+
+    // Marks of the labels of the mask
+    MaskPtr findMarks() const;
+
+    // Add sign times the labels of r in the mask, or of labels, to the counts
+    void count(cv::Rect const &r, int sign);
+    void count(Labels const &labels, int sign);
+    void recount();
+
+    // (version, rect) of recent changes
+    std::deque<std::pair<int, cv::Rect>> changes;
+
+    MaskPtr mask;
+    MaskPtr marks;      // null unless marking
+    std::vector<int64_t> counts;
 
     QVector<QRgb> palette;
-    bool dirty;
 
     int default_label;
     int opacity;
+    bool outlined;
+
+    int version;
 
 };
 
 
+typedef Layer_<label_t> Layer;
 typedef std::shared_ptr<Layer> LayerPtr;
 
 #endif // LAYER_H
@@ -1,4 +1,5 @@
 #include "mainwindow.h"
+#include "maskbench.h"
 #include <QApplication>
 
 #include <QCommandLineParser>
@@ -17,9 +18,19 @@ int main(int argc, char *argv[])
 
     parser.addPositionalArgument("source", QCoreApplication::translate("main", "Source directory to scan."));
 
+    QCommandLineOption benchmark("benchmark-masks",
+        QCoreApplication::translate("main", "Compare mask formats on the masks in <directory> and exit."),
+        QCoreApplication::translate("main", "directory"));
+    parser.addOption(benchmark);
+
 
     parser.process(app);
 
+    if(parser.isSet(benchmark)) {
+        benchmarkMasks(QDir(parser.value(benchmark)));
+        return 0;
+    }
+
     const QStringList args = parser.positionalArguments();
 
     MainWindow w;
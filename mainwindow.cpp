@@ -2,6 +2,15 @@
 #include "ui_mainwindow.h"
 
 #include "canvas.h"
+#include "maskio.h"
+#include "classifier.h"
+#include "grabcut.h"
+#include "watershed.h"
+#include "prediction.h"
+#include "uncertainty.h"
+#include "disagreement.h"
+#include "cleanup.h"
+#include "filmstrip.h"
 
 #include <QFileInfo>
 #include <QPixmap>
@@ -15,8 +24,15 @@
 #include <QActionGroup>
 #include <QProcess>
 #include <QMessageBox>
+#include <QtConcurrent>
+#include <QImageReader>
+#include <QImageIOHandler>
+#include <QSignalBlocker>
+#include <QScrollBar>
+#include <QDockWidget>
 
 #include <iostream>
+#include <algorithm>
 #include <fstream>
 
 #include <opencv2/imgproc.hpp>
@@ -28,11 +44,30 @@ inline QColor toColor(QJsonValue const &v) {
     return QColor(c[0].toInt(), c[1].toInt(), c[2].toInt(), c[3].toInt());
 }
 
-inline OptionalFileInfo findNext(QString const& path, Image& image, OptionalFileInfo const& current=OptionalFileInfo(), bool reverse=false, bool fresh=false);
-inline cv::Mat1b loadMask(std::string const &path);
+inline QFileInfoList imageEntries(QString const &path);
+inline OptionalFileInfo findNext(QFileInfoList entries, Image& image, OptionalFileInfo const& current=OptionalFileInfo(), bool reverse=false, bool fresh=false);
+inline bool loadPreview(QString const &path, Image &image);
+inline bool loadImage(QString const &path, Image &image);
 inline bool loadModel(QDir const& modelDir, Image &image);
 
 
+// longest side of the reduced decode shown while a large image loads
+static int const previewSize = 1024;
+
+// largest mask (in pixels) which also gets a PNG copy when saved
+static size_t const maxPngCopy = size_t(1) << 28;
+
+// rows of the prediction committed to the refine layer at a time
+static int const commitRows = 256;
+
+// cleanup: regions smaller than this are islands, holes up to this are filled
+static int const islandArea = 64;
+static int const holeArea = 1024;
+
+// of the majority filter smoothing boundaries
+static int const smoothRadius = 2;
+
+
 inline std::shared_ptr<Config> loadConfig(QJsonObject const &root) {
 
     std::shared_ptr<Config> config (new Config());
@@ -76,7 +111,7 @@ std::shared_ptr<Config> readConfig(QString const &path) {
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent),
-    ui(new Ui::MainWindow)
+    ui(new Ui::MainWindow), trainedVersion(-1)
 {
 
     ui->setupUi(this);
@@ -108,30 +143,219 @@ MainWindow::MainWindow(QWidget *parent)
     connect(ui->action_Delete, &QAction::triggered, canvas, &Canvas::deleteSelection);
 //    connect(new QShortcut(ui->action_Delete->shortcut(), canvas), &QShortcut::activated, canvas, &Canvas::deleteSelection);
 
-    connect(new QShortcut(Qt::Key_Escape, canvas), &QShortcut::activated, canvas, &Canvas::cancel);
+    connect(new QShortcut(Qt::Key_Escape, canvas), &QShortcut::activated, [=] () {
+        canvas->cancel();
+
+        grabCut->cancel();
+        ui->statusBar->clearMessage();
+    });
 
 
     connect(ui->actionSelect, &QAction::triggered, canvas, &Canvas::setSelect);
     connect(ui->actionPoints, &QAction::triggered, canvas, &Canvas::setPoints);
     connect(ui->actionLines, &QAction::triggered, canvas, &Canvas::setLines);
     connect(ui->actionFill, &QAction::triggered, canvas, &Canvas::setFill);
+    connect(ui->actionAccept, &QAction::triggered, canvas, &Canvas::setAccept);
+    connect(ui->actionWand, &QAction::triggered, canvas, &Canvas::setWand);
+    connect(ui->wandTolerance, &QSlider::valueChanged, canvas, &Canvas::setWandTolerance);
     //connect(ui->actionSuperPixels, &QAction::triggered, canvas, &Canvas::setSuperPixels);
     connect(ui->actionPolygons, &QAction::triggered, canvas, &Canvas::setPolygons);
+    connect(ui->actionSnap, &QAction::toggled, canvas, &Canvas::setSnap);
 
 
     connect(ui->actionRefine, &QAction::toggled, [=](bool on) {
             canvas->setActiveLayer(on ? 1 : 0);
+            startWatershed();
+            updateLabelCounts();
         });
 
 
+    connect(&loader, &QFutureWatcher<Image>::finished, [=] () {
+        if(loader.isCanceled())
+            return;
+
+        Image loaded = loader.result();
+
+        if(loaded.image) {
+            setImage(loaded);
+        } else {
+            QMessageBox::warning(this, "Open", "Failed to load: " + currentEntry->fileName());
+        }
+    });
+
     connect(ui->actionRun, &QAction::triggered, this, &MainWindow::runClassifier);
-    //connect(ui->actionGrabCut, &QAction::triggered, this, &MainWindow::runGrabCut);
+
+    classifier = new Classifier(this);
+
+    connect(ui->actionLiveClassifier, &QAction::toggled, [=](bool on) {
+        trainedVersion = -1;
+
+        if(on) trainClassifier();
+        else classifier->cancel();
+    });
+
+    connect(canvas, &Canvas::edited, this, &MainWindow::trainClassifier);
+
+    connect(classifier, &Classifier::predicted, this, [=](PredictedTile const &tile) {
+        if(tile.run == classifier->currentRun() && layers[0]->size() == canvas->imageSize()) {
+            layers[0]->setRegion(tile.rect, tile.labels);
+            canvas->update();
+        }
+    });
+
+    watershed = new Watershed(this);
+    connect(ui->actionWatershed, &QAction::toggled, this, &MainWindow::startWatershed);
+    connect(canvas, &Canvas::edited, watershed, &Watershed::update);
+    connect(watershed, &Watershed::updated, canvas, static_cast<void (Canvas::*)()>(&Canvas::update));
+
+    grabCut = new GrabCut(this);
+    connect(ui->actionGrabCut, &QAction::triggered, this, &MainWindow::runGrabCut);
+    connect(grabCut, &GrabCut::progress, this, [=](int run, int iteration, int total) {
+        if(run == grabCut->currentRun()) {
+            ui->statusBar->showMessage(QString("GrabCut iteration %1 of %2 (Esc cancels)").arg(iteration).arg(total));
+        }
+    });
+
+    connect(grabCut, &GrabCut::finished, this, [=](GrabCutResult const &result) {
+        if(result.run != grabCut->currentRun() || result.layer->size() != canvas->imageSize())
+            return;
+
+        ui->statusBar->clearMessage();
+
+        // over the labels as they are now, the layer may have been edited meanwhile
+        LabelMat labels = result.layer->getRegion(result.selection);
+        labels.setTo(result.label, result.foreground);
+
+        canvas->snapshot();
+        result.layer->setRegion(result.selection, labels);
+
+        canvas->update();
+        emit canvas->edited();
+    });
+
+    classBias.assign(labelCount, 0);
+
+    // the view follows the sliders, the rest of the image once they settle
+    predictionTimer.setSingleShot(true);
+    predictionTimer.setInterval(200);
+    connect(&predictionTimer, &QTimer::timeout, [=] () { previewPrediction(true); });
+
+    connect(ui->predictionThreshold, &QSlider::valueChanged, [=] () {
+        previewPrediction(false);
+        predictionTimer.start();
+    });
+
+    connect(ui->classBias, &QSlider::valueChanged, [=] (int bias) {
+        classBias[canvas->getLabel()] = bias;
+
+        previewPrediction(false);
+        predictionTimer.start();
+    });
+
+    connect(ui->actionCommitPrediction, &QAction::triggered, this, &MainWindow::commitPrediction);
+
+    uncertainty = new UncertaintyQueue(this);
+    disagreement = std::make_shared<Disagreement>();
+    disagreementIndex = 0;
+
+    connect(uncertainty, &UncertaintyQueue::progress, [=](int scored, int total) {
+        ui->statusBar->showMessage(QString("Scoring uncertainty %1 of %2").arg(scored).arg(total), 1000);
+    });
+
+    connect(ui->actionNextDisagreement, &QAction::triggered, this, &MainWindow::nextDisagreement);
+
+    // thumbnails of the images around the current one
+    filmstrip = new Filmstrip();
+
+    QDockWidget *filmstripDock = new QDockWidget("Filmstrip", this);
+    filmstripDock->setObjectName("filmstripDock");
+    filmstripDock->setWidget(filmstrip);
+
+    addDockWidget(Qt::BottomDockWidgetArea, filmstripDock);
+    ui->menuNavigate->addAction(filmstripDock->toggleViewAction());
+
+    connect(filmstrip, &Filmstrip::chosen, this, &MainWindow::openEntry);
+
+    connect(ui->actionRemoveIslands, &QAction::triggered, [=] () {
+        int ignore = config ? config->ignore_label : -1;
+        cleanupLabels([=] (LabelMat &labels, bool open) { removeIslands(labels, islandArea, ignore, open); });
+    });
+
+    connect(ui->actionFillHoles, &QAction::triggered, [=] () {
+        int label = canvas->getLabel();
+        cleanupLabels([=] (LabelMat &labels, bool) { fillHoles(labels, label, holeArea); });
+    });
+
+    connect(ui->actionSmoothBoundaries, &QAction::triggered, [=] () {
+        int ignore = config ? config->ignore_label : -1;
+        cleanupLabels([=] (LabelMat &labels, bool) { smoothBoundaries(labels, smoothRadius, ignore); });
+    });
+
+    connect(canvas, &Canvas::edited, this, &MainWindow::updateLabelCounts);
+
+    // once in use, kept up to date as the labels are edited
+    connect(canvas, &Canvas::edited, [=] () {
+        if(config && !disagreement->mask().empty()
+                && disagreement->update(*layers[0], *layers[1], config->ignore_label)) {
+            disagreementIndex = 0;
+        }
+    });
+
+    // new images are scored and shown as they appear, our own files
+    // (masks, logs, caches) leave the list of images as it was
+    datasetTimer.setSingleShot(true);
+    datasetTimer.setInterval(1000);
+
+    connect(&datasetWatcher, &QFileSystemWatcher::directoryChanged, [=](QString const &path) {
+        if(path == currentPath) datasetTimer.start();
+    });
+
+    connect(&datasetTimer, &QTimer::timeout, [=] () {
+        if(datasetLister.isRunning()) {
+            datasetTimer.start();
+            return;
+        }
+
+        QString path = listedPath = currentPath;
+        datasetLister.setFuture(QtConcurrent::run([=] () {
+            return imageEntries(path);
+        }));
+    });
+
+    connect(&datasetLister, &QFutureWatcher<QFileInfoList>::finished, [=] () {
+        QFileInfoList entries = datasetLister.result();
+
+        auto sameName = [](QFileInfo const &a, QFileInfo const &b) { return a.fileName() == b.fileName(); };
+        bool same = entries.size() == datasetEntries.size() && std::equal(entries.begin(), entries.end(), datasetEntries.begin(), sameName);
+
+        if(listedPath != currentPath || same)
+            return;
+
+        datasetEntries = entries;
+        uncertainty->scan(currentPath, entries);
+
+        filmstrip->setEntries(entries);
+        if(currentEntry) filmstrip->setCurrent(*currentEntry);
+    });
+
+    // writing into a .model directory doesn't change the dataset directory
+    predictionPoll.setInterval(60000);
+
+    connect(&predictionPoll, &QTimer::timeout, [=] () {
+        if(!currentPath.isEmpty() && !uncertainty->isScanning())
+            uncertainty->scan(currentPath, datasetEntries);
+    });
+
+    predictionPoll.start();
 
 
     connect(ui->brushWidth, &QSlider::valueChanged, canvas, &Canvas::setBrushWidth);
     connect(ui->labelOpacity, &QSlider::valueChanged, setLayerOpacity(0));
     connect(ui->refineOpacity, &QSlider::valueChanged, setLayerOpacity(1));
 
+    connect(ui->actionOutlineLabels, &QAction::toggled, setLayerOutlined(0));
+    connect(ui->actionOutlineRefine, &QAction::toggled, setLayerOutlined(1));
+
 
     connect(canvas, &Canvas::brushWidthChanged, ui->brushWidth, &QSlider::setValue);
 
@@ -163,10 +387,17 @@ MainWindow::MainWindow(QWidget *parent)
     group->addAction(ui->actionPoints);
     group->addAction(ui->actionLines);
     group->addAction(ui->actionFill);
+    group->addAction(ui->actionAccept);
+    group->addAction(ui->actionWand);
     group->addAction(ui->actionSuperPixels);
 
     ui->actionPoints->setChecked(true);
     canvas->setMode(Points);
+
+    QActionGroup *formats = new QActionGroup(this);
+    formats->addAction(ui->actionPngMasks);
+    formats->addAction(ui->actionRawMasks);
+    formats->addAction(ui->actionPackedMasks);
 }
 
 inline QListWidgetItem *makeLabel(Label const &label) {
@@ -176,6 +407,7 @@ inline QListWidgetItem *makeLabel(Label const &label) {
 
     QListWidgetItem *item = new QListWidgetItem(label.name.c_str());
     item->setData(Qt::UserRole, QVariant(label.value));
+    item->setData(Qt::UserRole + 1, QVariant(label.name.c_str()));
     item->setIcon(QIcon(p));
 
     return item;
@@ -183,7 +415,7 @@ inline QListWidgetItem *makeLabel(Label const &label) {
 
 
 inline QVector<QRgb> configColorTable(Config const &c) {
-    QVector<QRgb> palette(256, c.ignore_color.rgba());
+    QVector<QRgb> palette(labelCount, c.ignore_color.rgba());
 
     int i = 0;
     for (Label const& l : c.labels) {
@@ -219,8 +451,10 @@ bool MainWindow::open(QString const &path) {
     }
 
     Image image;
-    OptionalFileInfo next = findNext(path, image, OptionalFileInfo(), false, ui->actionFresh->isChecked());
-    if(!next) next = findNext(path, image, OptionalFileInfo(), false, !ui->actionFresh->isChecked());
+    QFileInfoList entries = imageEntries(path);
+
+    OptionalFileInfo next = findNext(entries, image, OptionalFileInfo(), false, ui->actionFresh->isChecked());
+    if(!next) next = findNext(entries, image, OptionalFileInfo(), false, !ui->actionFresh->isChecked());
 
 
     if(!next) {
@@ -232,6 +466,14 @@ bool MainWindow::open(QString const &path) {
     currentPath = path;
     currentEntry = next;
 
+    if(!datasetWatcher.directories().isEmpty())
+        datasetWatcher.removePaths(datasetWatcher.directories());
+
+    datasetWatcher.addPath(path);
+    datasetEntries = entries;
+
+    uncertainty->scan(path, entries);
+
     ui->labelList->clear();
 
     for(auto& label: config->labels)
@@ -240,6 +482,7 @@ bool MainWindow::open(QString const &path) {
     Label ignoreLabel("ignored", config->ignore_label, config->ignore_color);
     ui->labelList->addItem(makeLabel(ignoreLabel));
     layers[1]->setDefaultLabel(ignoreLabel.value);
+    canvas->setIgnoreLabel(ignoreLabel.value);
 
 
     ui->labelList->setCurrentRow(0);
@@ -250,6 +493,10 @@ bool MainWindow::open(QString const &path) {
 
     layers[1]->setDefaultLabel(ignoreLabel.value);
 
+    filmstrip->setEntries(entries);
+    filmstrip->setColors(layers[1]->getPalette());
+    filmstrip->setCurrent(*next);
+
     setImage(image);
     this->setWindowTitle(next->fileName());
 
@@ -259,15 +506,164 @@ bool MainWindow::open(QString const &path) {
 
 
 void MainWindow::setImage(Image const &loaded) {
+    classifier->cancel();
+    grabCut->cancel();
+    watershed->stop();
+
+    disagreement->reset();
+    disagreementIndex = 0;
+
+    if(loaded.preview) {
+        canvas->setPreview(loaded.image);
+        currentImage = loaded;
+
+        // the full image and masks replace the preview when they're ready
+        QString path = currentEntry->absoluteFilePath();
+        loader.setFuture(QtConcurrent::run([=] () {
+            Image image;
+            loadImage(path, image);
+            return image;
+        }));
+
+        return;
+    }
+
+    // a load still running is for an image we've moved past
+    loader.cancel();
+
     canvas->setImage(loaded.image);
 
     if(!loaded.prediction.empty())
         layers[0]->setMask(loaded.prediction);
 
-    if(!loaded.labels.empty())
+    if(loaded.labels)
         layers[1]->setMask(loaded.labels);
 
     currentImage = loaded;
+    currentImage.labels.reset();    // owned by the layer now
+
+    trainedVersion = -1;
+    trainClassifier();
+
+    if(ui->predictionThreshold->value() > 0 || std::count(classBias.begin(), classBias.end(), 0) < int(classBias.size()))
+        previewPrediction(true);
+
+    startWatershed();
+    updateLabelCounts();
+}
+
+
+void MainWindow::updateLabelCounts() {
+    LayerPtr layer = canvas->getActiveLayer();
+    if(!config || canvas->isLoading() || !layer || layer->size().area() == 0)
+        return;
+
+    double total = layer->size().area();
+    QStringList missing;
+
+    for(int i = 0; i < ui->labelList->count(); ++i) {
+        QListWidgetItem *item = ui->labelList->item(i);
+
+        int label = item->data(Qt::UserRole).toInt();
+        QString name = item->data(Qt::UserRole + 1).toString();
+
+        int64_t n = layer->getCount(label);
+        item->setText(QString("%1  %2%").arg(name).arg(100.0 * n / total, 0, 'f', 1));
+
+        bool absent = n == 0 && label != config->ignore_label;
+        item->setForeground(absent ? QBrush(Qt::red) : QBrush());
+
+        if(absent) missing << name;
+    }
+
+    // only when it changes, not on every stroke
+    if(missing != missingLabels && !missing.isEmpty()) {
+        ui->statusBar->showMessage("No pixels labelled " + missing.join(", "), 5000);
+    }
+
+    missingLabels = missing;
+}
+
+
+void MainWindow::previewPrediction(bool whole) {
+    std::vector<cv::Mat1b> const &probs = currentImage.probs;
+
+    if(!config || probs.empty() || canvas->isLoading() || probs[0].size() != canvas->imageSize())
+        return;
+
+    cv::Rect r = whole ? cv::Rect(cv::Point(), canvas->imageSize()) : canvas->viewRect();
+    if(r.area() == 0)
+        return;
+
+    std::vector<int> bias(probs.size());
+    for(size_t c = 0; c < bias.size(); ++c) {
+        bias[c] = classBias[c] * 255 / 100;
+    }
+
+    LabelMat labels;
+    predictLabels(probs, bias, ui->predictionThreshold->value() * 255 / 100, config->ignore_label, r, labels);
+
+    layers[0]->setRegion(r, labels);
+    canvas->update();
+}
+
+
+void MainWindow::commitPrediction() {
+    cv::Size size = canvas->imageSize();
+
+    if(!config || canvas->isLoading() || layers[0]->size() != size || layers[1]->size() != size)
+        return;
+
+    int ignore = config->ignore_label;
+    bool snapshot = false;
+
+    for(int y = 0; y < size.height; y += commitRows) {
+        cv::Rect band(0, y, size.width, std::min<int>(commitRows, size.height - y));
+
+        LabelMat predicted = layers[0]->getRegion(band);
+        LabelMat labels = layers[1]->getRegion(band);
+
+        cv::Mat1b unlabelled = (labels == ignore) & (predicted != ignore);
+        if(!cv::countNonZero(unlabelled))
+            continue;
+
+        // one undo step for the whole commit
+        if(!snapshot) {
+            canvas->snapshot();
+            snapshot = true;
+        }
+
+        predicted.copyTo(labels, unlabelled);
+        layers[1]->setRegion(band, labels);
+    }
+
+    if(snapshot) {
+        canvas->update();
+        emit canvas->edited();
+    }
+}
+
+
+void MainWindow::startWatershed() {
+    if(ui->actionWatershed->isChecked() && canvas->getImage() && !canvas->isLoading()) {
+        watershed->start(canvas->getImage(), canvas->getActiveLayer(), canvas->viewRect());
+    } else {
+        watershed->stop();
+    }
+}
+
+
+void MainWindow::trainClassifier() {
+    LayerPtr labels = layers[1];
+
+    if(!ui->actionLiveClassifier->isChecked() || !config || !canvas->getImage() || canvas->isLoading()
+            || labels->getVersion() == trainedVersion)
+        return;
+
+    cv::Rect edited = labels->changedSince(trainedVersion);
+    trainedVersion = labels->getVersion();
+
+    classifier->start(canvas->getImage(), labels->snapshot(), config->ignore_label, canvas->viewRect(), edited);
 }
 
 
@@ -277,6 +673,9 @@ void MainWindow::setLabel(int label) {
     } else {
         canvas->setLabel(config->ignore_label);
     }
+
+    QSignalBlocker block(ui->classBias);
+    ui->classBias->setValue(classBias[canvas->getLabel()]);
 }
 
 void MainWindow::keyPressEvent(QKeyEvent *event) {
@@ -330,6 +729,23 @@ QString replaceExt(QString const &path, QString const &ext) {
     return QString (info.path() + "/" + info.completeBaseName() + ext);
 }
 
+// Moves from over to, to is left as it was if that fails
+bool replaceFile(QString const &from, QString const &to) {
+    QString old = to + ".old";
+    QFile::remove(old);
+
+    if(QFile::exists(to) && !QFile::rename(to, old))
+        return false;
+
+    if(!QFile::rename(from, to)) {
+        QFile::rename(old, to);
+        return false;
+    }
+
+    QFile::remove(old);
+    return true;
+}
+
 
 
 bool MainWindow::save() {
@@ -348,18 +764,53 @@ bool MainWindow::save() {
         }
 
 
-        QString temp = QDir::tempPath() + "/mask.png";
         QString labelFile = currentEntry->absoluteFilePath() + ".mask";
+        LayerPtr layer = canvas->getActiveLayer();
+
+        // too large to hold densely for a PNG, kept packed instead
+        bool png = ui->actionPngMasks->isChecked();
+        cv::Size size = layer->size();
+
+        if(png && size_t(size.width) * size.height > maxPngCopy) {
+            ui->statusBar->showMessage("Mask too large for PNG, saved as a packed mask", 5000);
+            png = false;
+        }
+
+        if(!png) {
+            // beside the mask, so it's moved rather than copied over it
+            QString temp = labelFile + ".tmp";
+            MaskPtr mask = layer->snapshot();
+
+            bool written = ui->actionRawMasks->isChecked() ? writeRawMask(temp, *mask) : writePackedMask(temp, *mask);
 
+            // the old mask is kept unless the new one is complete
+            if(!written || !replaceFile(temp, labelFile)) {
+                QFile::remove(temp);
+                QMessageBox::warning(this, "Save", "Failed to write: " + labelFile);
 
-        cv::Mat1b mask = canvas->getActiveLayer()->getMask();
-        cv::imwrite(temp.toStdString(), mask);
+                return false;
+            }
+
+            // PNG copy for tools which don't read our formats, unless
+            // the mask is too large to hold densely
+            QString pngFile = labelFile + ".png";
+            if(size_t(mask->rows) * mask->cols <= maxPngCopy) {
+                QtConcurrent::run([=] () {
+                    cv::imwrite(pngFile.toStdString(), mask->dense());
+                });
+            }
 
-        std::cout << temp.toStdString() << std::endl;
+        } else {
+            QString temp = labelFile + ".tmp.png";
 
+            LabelMat mask = layer->getMask();
+            if(!cv::imwrite(temp.toStdString(), mask) || !replaceFile(temp, labelFile)) {
+                QFile::remove(temp);
+                QMessageBox::warning(this, "Save", "Failed to write: " + labelFile);
 
-        QFile::remove(labelFile);
-        QFile::rename(temp, labelFile);
+                return false;
+            }
+        }
 
         std::vector<Event> log = canvas->getLog();
         QJsonArray events;
@@ -382,6 +833,7 @@ bool MainWindow::save() {
 
 
         std::cout << "Writing " << labelFile.toStdString() << std::endl;
+        filmstrip->refresh(*currentEntry);
     }
 
     return true;
@@ -395,10 +847,12 @@ void MainWindow::discardImage() {
         QFile file(currentEntry->absoluteFilePath());
         QFile annot(currentEntry->absoluteFilePath() + ".json");
         QFile labels(currentEntry->absoluteFilePath() + ".mask");
+        QFile labelsCopy(currentEntry->absoluteFilePath() + ".mask.png");
 
         file.remove();
         annot.remove();
         labels.remove();
+        labelsCopy.remove();
 
         loadNext(false);
     }
@@ -412,9 +866,118 @@ void MainWindow::prevImage() {
     if(save()) loadNext(true);
 }
 
+void MainWindow::openEntry(QFileInfo const &entry) {
+    if(!currentEntry || entry == *currentEntry || !save())
+        return;
+
+    Image loaded;
+    QString path = entry.absoluteFilePath();
+
+    if(loadPreview(path, loaded) || loadImage(path, loaded)) {
+        this->setWindowTitle(entry.fileName());
+
+        currentEntry = entry;
+        setImage(loaded);
+    }
+
+    filmstrip->setCurrent(*currentEntry);
+}
+
+void MainWindow::nextDisagreement() {
+    if(!config || canvas->isLoading())
+        return;
+
+    // after an edit the largest remaining region comes first again
+    if(disagreement->update(*layers[0], *layers[1], config->ignore_label)) {
+        disagreementIndex = 0;
+    }
+
+    auto const &regions = disagreement->regions();
+    if(regions.empty()) {
+        ui->statusBar->showMessage("Prediction and labels agree", 3000);
+        return;
+    }
+
+    disagreementIndex %= regions.size();
+    Disagreement::Region const &region = regions[disagreementIndex++];
+
+    canvas->setHighlight(region.rect);
+
+    // centred in the view
+    float zoom = canvas->getZoom();
+    QWidget *viewport = ui->scrollArea->viewport();
+
+    ui->scrollArea->horizontalScrollBar()->setValue(int((region.rect.x + region.rect.width / 2.0f) * zoom) - viewport->width() / 2);
+    ui->scrollArea->verticalScrollBar()->setValue(int((region.rect.y + region.rect.height / 2.0f) * zoom) - viewport->height() / 2);
+
+    ui->statusBar->showMessage(QString("Disagreement %1 of %2, %3 pixels")
+        .arg(disagreementIndex).arg(regions.size()).arg(region.area));
+}
+
+
+void MainWindow::cleanupLabels(std::function<void(LabelMat &, bool)> const &op) {
+    cv::Rect bounds(cv::Point(), canvas->imageSize());
+    LayerPtr layer = canvas->getActiveLayer();
+
+    if(canvas->isLoading() || !layer || layer->size() != bounds.size())
+        return;
+
+    cv::Rect r = cv::Rect(canvas->getSelection()) & bounds;
+    if(r.area() == 0)
+        return;
+
+    LabelMat before = layer->getRegion(r);
+    LabelMat labels = before.clone();
+
+    op(labels, r != bounds);
+
+    int changed = cv::countNonZero(labels != before);
+    if(!changed) {
+        ui->statusBar->showMessage("Nothing to clean up", 3000);
+        return;
+    }
+
+    // one undo step, of the region alone
+    canvas->snapshot(r);
+    layer->setRegion(r, labels);
+
+    canvas->update();
+    emit canvas->edited();
+
+    ui->statusBar->showMessage(QString("Changed %1 pixels").arg(changed), 3000);
+}
+
+
 void MainWindow::runGrabCut() {
-//    canvas->grabCut();
+    cv::Rect bounds(cv::Point(), canvas->imageSize());
+    if(!canvas->getImage() || canvas->isLoading())
+        return;
+
+    cv::Rect selection = cv::Rect(canvas->getSelection()) & bounds;
+    cv::Rect roi = cv::Rect(selection.x - GrabCut::margin, selection.y - GrabCut::margin,
+                            selection.width + 2 * GrabCut::margin, selection.height + 2 * GrabCut::margin) & bounds;
+
+    if(selection.area() == 0)
+        return;
+
+    LayerPtr layer = canvas->getActiveLayer();
+    int label = canvas->getLabel();
 
+    // predictions are a hint for refinement, strokes on the active layer are certain
+    LabelMat base;
+    if(layer != layers[0])
+        base = layers[0]->getRegion(roi);
+
+    cv::Mat1b seeds = grabCutSeeds(layer->getRegion(roi), layer->getDefaultLabel(), base, label);
+
+    int foreground = cv::countNonZero((seeds == cv::GC_FGD) | (seeds == cv::GC_PR_FGD));
+    if(foreground == 0 || foreground == int(seeds.total())) {
+        ui->statusBar->showMessage("GrabCut needs both the current label and other labels in the selection", 3000);
+        return;
+    }
+
+    ui->statusBar->showMessage("GrabCut started (Esc cancels)");
+    grabCut->start(canvas->getImage(), roi, seeds, selection, layer, label);
 }
 
 
@@ -438,6 +1001,7 @@ void MainWindow::runClassifier() {
         assert (!currentImage.prediction.empty());
 
         layers[0]->setMask(currentImage.prediction);
+        uncertainty->scan(currentPath, imageEntries(currentPath));
 
     } else {
         QString perr = p.readAllStandardError();
@@ -447,29 +1011,15 @@ void MainWindow::runClassifier() {
 
 
 
-inline cv::Mat1b loadMask(std::string const &path) {
-    cv::Mat mask = cv::imread(path);
-
-    if(mask.channels() > 1) {
-        std::vector<cv::Mat> channels;
-        cv::split(mask, channels);
-
-        mask = channels[0];
-    }
-
-    return mask;
-}
-
-
 inline bool loadModel(QDir const& modelDir, Image &image) {
 
     if(modelDir.exists()) {
-        std::string maskPath = (modelDir.path() + "/predictions.png").toStdString();
+        QString maskPath = modelDir.path() + "/predictions.png";
 
 
-        std::cout << maskPath << std::endl;
+        std::cout << maskPath.toStdString() << std::endl;
 
-        image.prediction = loadMask(maskPath);
+        image.prediction = readMaskImage(maskPath);
 
         int i = 0;
         while(true) {
@@ -492,23 +1042,54 @@ inline bool loadModel(QDir const& modelDir, Image &image) {
 }
 
 
+// JPEGs can be decoded at a fraction of their size for a fast first paint,
+// false if the image is small enough (or another format) to load directly
+inline bool loadPreview(QString const &path, Image &image) {
+    QString suffix = QFileInfo(path).suffix().toLower();
+    if(suffix != "jpg" && suffix != "jpeg")
+        return false;
+
+    QImageReader reader(path);
+    QSize stored = reader.size();
+
+    QSize size = stored;
+    if(reader.transformation() & QImageIOHandler::TransformationRotate90) {
+        size.transpose();
+    }
+
+    int longest = std::max(size.width(), size.height());
+
+    for(int factor : {8, 4, 2}) {
+        if(longest / factor < previewSize)
+            continue;
+
+        // scaled by the JPEG decoder, before any EXIF rotation
+        QImage preview = decodeImage(path, stored / factor, image.copied);
+        if(preview.isNull())
+            return false;
+
+        image.image = std::make_shared<PreviewSource>(preview, cv::Size(size.width(), size.height()));
+        image.preview = true;
+        return true;
+    }
+
+    return false;
+}
+
+
 inline bool loadImage(QString const &path, Image &image) {
 
     std::cout << "loading: " << path.toStdString() << std::endl;
-    image.image = cv::imread(path.toStdString(), cv::IMREAD_COLOR);
+    image.image = openImage(path, image.copied);
 
-    if(!image.image.empty()) {
-        cv::cvtColor(image.image, image.image, cv::COLOR_BGR2RGB);
+    if(image.image) {
+        std::cout << "copied after decoding: " << image.copied << " bytes" << std::endl;
 
         QDir modelDir(path + ".model");
             loadModel(modelDir, image);
 
 
-        std::string maskPath = (path + ".mask").toStdString();
-        cv::Mat1b annotated = loadMask(maskPath);
-        if(!annotated.empty()) {
-            image.labels = annotated;
-        }
+        image.labels = readMask(path + ".mask");
 
         return true;
     }
@@ -516,13 +1097,16 @@ inline bool loadImage(QString const &path, Image &image) {
     return false;
 }
 
-inline OptionalFileInfo findNext(QString const& path, Image& image, OptionalFileInfo const& current, bool reverse, bool fresh) {
+inline QFileInfoList imageEntries(QString const &path) {
     QStringList filters;
-    filters << "*.png" << "*.jpg" << "*.PNG" << "*.jpeg" << "*.JPG" << "*.JPEG";
+    filters << "*.png" << "*.jpg" << "*.PNG" << "*.jpeg" << "*.JPG" << "*.JPEG" << "*.tif" << "*.tiff" << "*.TIF" << "*.TIFF";
 
     QDir dir(path);
+    return dir.entryInfoList(filters, QDir::Files|QDir::NoDotAndDotDot);
+}
+
 
-    QFileInfoList entries = dir.entryInfoList(filters, QDir::Files|QDir::NoDotAndDotDot);
+inline OptionalFileInfo findNext(QFileInfoList entries, Image& image, OptionalFileInfo const& current, bool reverse, bool fresh) {
     if(reverse) std::reverse(entries.begin(), entries.end());
     int i = 0;
 
@@ -542,8 +1126,7 @@ inline OptionalFileInfo findNext(QString const& path, Image& image, OptionalFile
 //        if(!fresh && !annot.exists())
 //            continue;
 
-        QPixmap p;
-        if(loadImage(name, image)) {
+        if(loadPreview(name, image) || loadImage(name, image)) {
             return e;
         }
     }
@@ -554,14 +1137,20 @@ inline OptionalFileInfo findNext(QString const& path, Image& image, OptionalFile
 
 bool MainWindow::loadNext(bool reverse) {
 
+    QFileInfoList entries = imageEntries(currentPath);
+    if(ui->actionByUncertainty->isChecked()) {
+        entries = uncertainty->order(entries);
+    }
+
     Image loaded;
-    auto next = findNext(currentPath, loaded, currentEntry, reverse, ui->actionFresh->isChecked());
+    auto next = findNext(entries, loaded, currentEntry, reverse, ui->actionFresh->isChecked());
     if(next) {
         this->setWindowTitle(next->fileName());
-        setImage(loaded);
-
 
         currentEntry = next;
+        setImage(loaded);
+
+        filmstrip->setCurrent(*next);
     }
 
     return bool(next);
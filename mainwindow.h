@@ -4,9 +4,12 @@
 #include <QMainWindow>
 #include <QDir>
 #include <QListWidget>
+#include <QFutureWatcher>
+#include <QFileSystemWatcher>
 
 #include <boost/optional.hpp>
 #include <memory>
+#include <functional>
 #include "state.h"
 #include "canvas.h"
 
@@ -14,6 +17,13 @@ namespace Ui {
 class MainWindow;
 }
 
+class Classifier;
+class GrabCut;
+class Watershed;
+class UncertaintyQueue;
+class Disagreement;
+class Filmstrip;
+
 
 typedef boost::optional<QFileInfo> OptionalFileInfo;
 class MainWindow : public QMainWindow
@@ -34,11 +44,37 @@ protected slots:
     void prevImage();
     void discardImage();
 
+    // Save the current image and open entry, chosen from the filmstrip
+    void openEntry(QFileInfo const &entry);
+
     void runClassifier();
     void runGrabCut();
 
+    // Retrain the live classifier if the refine layer has changed
+    void trainClassifier();
+
+    // Watershed fill of the active layer, if it's switched on
+    void startWatershed();
+
+    // Base layer from the class probabilities with the confidence and bias
+    // sliders applied, to the part in view or the whole image
+    void previewPrediction(bool whole);
+
+    // Confident predictions into the unlabelled pixels of the refine layer
+    void commitPrediction();
+
+    // Show the next largest region where prediction and labels disagree
+    void nextDisagreement();
+
+    // Replace the labels of the active layer, in the selection or the whole
+    // image, with op applied to them; open if that is part of the image
+    void cleanupLabels(std::function<void(LabelMat &labels, bool open)> const &op);
+
     void setLabel(int label);
 
+    // Area of each label in the active layer, missing ones marked
+    void updateLabelCounts();
+
 
 
 protected:
@@ -57,6 +93,14 @@ protected:
     std::function<void(int)> setLayerOpacity(int layer) {
         return [=] (int opacity) {
             layers[layer]->setOpacity(opacity);
+            canvas->update();
+        };
+    }
+
+    std::function<void(bool)> setLayerOutlined(int layer) {
+        return [=] (bool outlined) {
+            layers[layer]->setOutlined(outlined);
+            canvas->update();
         };
     }
 
@@ -75,6 +119,38 @@ private:
     Image currentImage;
 
     boost::optional<QFileInfo> currentEntry;
+
+    // full resolution load of the current image, while a preview is shown
+    QFutureWatcher<Image> loader;
+
+    Classifier *classifier;
+    int trainedVersion;     // of the refine layer the classifier last started on
+
+    GrabCut *grabCut;
+    Watershed *watershed;
+
+    std::vector<int> classBias;     // per label, percent of full probability
+    QTimer predictionTimer;
+
+    // Next and Prev can follow the model's uncertainty rather than names
+    UncertaintyQueue *uncertainty;
+    QFileSystemWatcher datasetWatcher;
+
+    // images of currentPath, listed again in the background once changes settle
+    QFileInfoList datasetEntries;
+    QFutureWatcher<QFileInfoList> datasetLister;
+    QString listedPath;
+    QTimer datasetTimer;
+
+    // predictions written into existing .model directories, found by rescanning
+    QTimer predictionPoll;
+
+    std::shared_ptr<Disagreement> disagreement;
+    int disagreementIndex;      // of the next region to show
+
+    QStringList missingLabels;      // as last shown
+
+    Filmstrip *filmstrip;
 };
 
 #endif // MAINWINDOW_H
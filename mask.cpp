@@ -0,0 +1,171 @@
+#include "mask.h"
+#include "rle.h"
+#include "raster.h"
+
+#include <cstring>
+#include <algorithm>
+#include <opencv2/imgproc.hpp>
+
+
+template<typename T>
+void MaskStore_<T>::fillRect(cv::Rect const &r, int label) {
+    for(int y = r.y; y < r.y + r.height; ++y) {
+        fillSpan(y, r.x, r.x + r.width, label);
+    }
+}
+
+template<typename T>
+int MaskStore_<T>::floodFill(cv::Point const &seed, int label, cv::Rect *rect) {
+    int target = at(seed.x, seed.y);
+    if(rect) *rect = cv::Rect();
+
+    if(target == label)
+        return 0;
+
+    int area = 0;
+    int left = cols, top = rows, right = 0, bottom = 0;
+
+    std::vector<T> buffer(cols);
+    Spans stack;
+
+    // fill every span of target in row y reachable from [x0, x1)
+    auto scan = [&](int y, int x0, int x1) {
+        T const *labels = row(y, 0, cols, buffer.data());
+
+        for(int x = x0; x < x1; ) {
+            if(labels[x] != target) {
+                ++x;
+                continue;
+            }
+
+            int start = x;
+            while(start > 0 && labels[start - 1] == target) --start;
+            while(x < cols && labels[x] == target) ++x;
+
+            fillSpan(y, start, x, label);
+            stack.push_back(Span(y, start, x));
+
+            area += x - start;
+            left = std::min(left, start);
+            right = std::max(right, x);
+            top = std::min(top, y);
+            bottom = std::max(bottom, y + 1);
+        }
+    };
+
+    scan(seed.y, seed.x, seed.x + 1);
+
+    while(!stack.empty()) {
+        Span s = stack.back();
+        stack.pop_back();
+
+        if(s.y > 0) scan(s.y - 1, s.x0, s.x1);
+        if(s.y + 1 < rows) scan(s.y + 1, s.x0, s.x1);
+    }
+
+    if(rect) *rect = cv::Rect(left, top, right - left, bottom - top);
+    return area;
+}
+
+template<typename T>
+void MaskStore_<T>::read(cv::Rect const &r, Labels &dst) const {
+    dst.create(r.height, r.width);
+
+    for(int y = 0; y < r.height; ++y) {
+        T *d = dst.template ptr<T>(y);
+        T const *s = row(r.y + y, r.x, r.x + r.width, d);
+
+        if(s != d) std::memcpy(d, s, r.width * sizeof(T));
+    }
+}
+
+template<typename T>
+void MaskStore_<T>::write(cv::Rect const &r, Labels const &src) {
+    for(int y = 0; y < r.height; ++y) {
+        writeRow(r.y + y, r.x, r.x + r.width, src.template ptr<T>(y));
+    }
+}
+
+template<typename T>
+typename MaskStore_<T>::Labels MaskStore_<T>::dense() const {
+    Labels m;
+    read(cv::Rect(0, 0, cols, rows), m);
+
+    return m;
+}
+
+
+
+template<typename T>
+void DenseMask_<T>::detach() {
+    if(owner) {
+        image = image.clone();
+        owner.reset();
+    }
+}
+
+template<typename T>
+T const *DenseMask_<T>::row(int y, int x0, int /* x1 */, T * /* buffer */) const {
+    return image.template ptr<T>(y) + x0;
+}
+
+template<typename T>
+void DenseMask_<T>::fillSpan(int y, int x0, int x1, int label) {
+    detach();
+    std::fill(image.template ptr<T>(y) + x0, image.template ptr<T>(y) + x1, T(label));
+}
+
+template<typename T>
+void DenseMask_<T>::writeRow(int y, int x0, int x1, T const *labels) {
+    detach();
+    std::memcpy(image.template ptr<T>(y) + x0, labels, (x1 - x0) * sizeof(T));
+}
+
+template<typename T>
+void DenseMask_<T>::fillRect(cv::Rect const &r, int label) {
+    detach();
+    image(r) = T(label);
+}
+
+template<typename T>
+int DenseMask_<T>::floodFill(cv::Point const &seed, int label, cv::Rect *rect) {
+    detach();
+
+    // cv::floodFill takes 8 bit images but not 16
+    if(sizeof(T) > 1) {
+        return MaskStore_<T>::floodFill(seed, label, rect);
+    }
+
+    cv::Scalar c(label, label, label);
+    return cv::floodFill(image, seed, c, rect);
+}
+
+template<typename T>
+void DenseMask_<T>::read(cv::Rect const &r, Labels &dst) const {
+    image(r).copyTo(dst);
+}
+
+template<typename T>
+void DenseMask_<T>::write(cv::Rect const &r, Labels const &src) {
+    detach();
+    src.copyTo(image(r));
+}
+
+
+template<typename T>
+typename DenseMask_<T>::Ptr DenseMask_<T>::snapshot() const {
+    Ptr runs = encodeMask(image);
+    return runs ? runs : clone();
+}
+
+template<typename T>
+typename DenseMask_<T>::Ptr DenseMask_<T>::clone() const {
+    return std::make_shared<DenseMask_>(image.clone());
+}
+
+
+template class MaskStore_<uint8_t>;
+template class MaskStore_<uint16_t>;
+
+template class DenseMask_<uint8_t>;
+template class DenseMask_<uint16_t>;
@@ -0,0 +1,108 @@
+#ifndef MASK_H
+#define MASK_H
+
+#include <memory>
+#include <cstdint>
+
+#include "opencv2/core.hpp"
+#include "labels.h"
+
+
+// Storage for the labels of a Layer. Stores provide rows and span writes,
+// anything more involved is done on a dense copy of a region.
+template<typename T>
+class MaskStore_ {
+
+public:
+    typedef std::shared_ptr<MaskStore_> Ptr;
+    typedef cv::Mat_<T> Labels;
+
+    MaskStore_(int rows, int cols) : rows(rows), cols(cols) {}
+    virtual ~MaskStore_() {}
+
+    // Labels [x0, x1) of row y, either in place or decoded into buffer
+    virtual T const *row(int y, int x0, int x1, T *buffer) const = 0;
+
+    virtual void fillSpan(int y, int x0, int x1, int label) = 0;
+    virtual void writeRow(int y, int x0, int x1, T const *labels) = 0;
+
+    virtual void fillRect(cv::Rect const &r, int label);
+
+    // 4-connected fill as cv::floodFill, returns the number of pixels filled
+    virtual int floodFill(cv::Point const &seed, int label, cv::Rect *rect = nullptr);
+
+    // True if [x0, x1) of row y is known to hold a single label, without looking at pixels
+    virtual bool uniform(int /* y */, int /* x0 */, int /* x1 */, int &/* label */) const {
+        return false;
+    }
+
+    virtual void read(cv::Rect const &r, Labels &dst) const;
+    virtual void write(cv::Rect const &r, Labels const &src);
+
+    virtual Labels dense() const;
+
+    // A compact, independent copy for keeping around (undo, caches)
+    virtual Ptr snapshot() const = 0;
+    virtual Ptr clone() const = 0;
+
+    virtual size_t bytes() const = 0;
+
+    int at(int x, int y) const {
+        T label;
+        return *row(y, x, x + 1, &label);
+    }
+
+    cv::Size size() const { return cv::Size(cols, rows); }
+
+    int const rows, cols;
+};
+
+
+template<typename T>
+class DenseMask_ : public MaskStore_<T> {
+
+public:
+    typedef typename MaskStore_<T>::Ptr Ptr;
+    typedef typename MaskStore_<T>::Labels Labels;
+
+    DenseMask_(Labels const &image)
+        : MaskStore_<T>(image.rows, image.cols), image(image) {}
+
+    // image points into memory held by owner (e.g. a read only file mapping),
+    // it is copied before the first write
+    DenseMask_(Labels const &image, std::shared_ptr<void const> const &owner)
+        : MaskStore_<T>(image.rows, image.cols), image(image), owner(owner) {}
+
+    T const *row(int y, int x0, int x1, T *buffer) const;
+
+    void fillSpan(int y, int x0, int x1, int label);
+    void writeRow(int y, int x0, int x1, T const *labels);
+
+    void fillRect(cv::Rect const &r, int label);
+    int floodFill(cv::Point const &seed, int label, cv::Rect *rect = nullptr);
+
+    void read(cv::Rect const &r, Labels &dst) const;
+    void write(cv::Rect const &r, Labels const &src);
+
+    // Shared with the store, not a copy (read only while mapped)
+    Labels dense() const { return image; }
+
+    Ptr snapshot() const;
+    Ptr clone() const;
+
+    size_t bytes() const { return image.step * image.rows; }
+
+private:
+    void detach();
+
+    Labels image;
+    std::shared_ptr<void const> owner;
+};
+
+
+typedef MaskStore_<label_t> MaskStore;
+typedef DenseMask_<label_t> DenseMask;
+
+typedef std::shared_ptr<MaskStore> MaskPtr;
+
+#endif // MASK_H
@@ -0,0 +1,129 @@
+#include "maskbench.h"
+#include "maskio.h"
+
+#include <QElapsedTimer>
+#include <QTemporaryFile>
+
+#include <iostream>
+#include <iomanip>
+#include <functional>
+
+#include <opencv2/imgcodecs.hpp>
+
+
+namespace {
+
+    int const repeats = 3;
+
+    // Best of a few runs, in milliseconds
+    double timeBest(std::function<void()> const &f) {
+        double best = 0;
+
+        for(int i = 0; i < repeats; ++i) {
+            QElapsedTimer timer;
+            timer.start();
+
+            f();
+
+            double ms = timer.nsecsElapsed() * 1e-6;
+            best = i == 0 ? ms : std::min(best, ms);
+        }
+
+        return best;
+    }
+
+
+    struct Result {
+        Result() : encode(0), decode(0), bytes(0) {}
+
+        Result &operator+=(Result const &r) {
+            encode += r.encode;
+            decode += r.decode;
+            bytes += r.bytes;
+            return *this;
+        }
+
+        double encode, decode;
+        size_t bytes;
+    };
+
+
+    Result benchPng(LabelMat const &labels) {
+        Result r;
+        std::vector<uchar> buffer;
+
+        r.encode = timeBest([&] () { cv::imencode(".png", labels, buffer); });
+        r.decode = timeBest([&] () { cv::imdecode(buffer, cv::IMREAD_UNCHANGED); });
+        r.bytes = buffer.size();
+
+        return r;
+    }
+
+    Result benchPacked(MaskStore const &mask) {
+        Result r;
+        QByteArray data;
+
+        r.encode = timeBest([&] () { data = packMask(mask); });
+        r.decode = timeBest([&] () { unpackMask(data); });
+        r.bytes = data.size();
+
+        return r;
+    }
+
+    // Written to and mapped from a temporary file, includes the checksum
+    Result benchRaw(MaskStore const &mask) {
+        Result r;
+
+        QTemporaryFile file;
+        if(!file.open()) return r;
+
+        r.encode = timeBest([&] () { writeRawMask(file.fileName(), mask); });
+        r.decode = timeBest([&] () { mapRawMask(file.fileName()); });
+        r.bytes = file.size();
+
+        return r;
+    }
+
+    void print(std::string const &name, Result const &r) {
+        std::cout << std::setw(8) << name
+                  << std::setw(12) << std::fixed << std::setprecision(2) << r.encode
+                  << std::setw(12) << r.decode
+                  << std::setw(14) << r.bytes << std::endl;
+    }
+}
+
+
+void benchmarkMasks(QDir const &dir) {
+    QFileInfoList entries = dir.entryInfoList(QStringList() << "*.mask", QDir::Files);
+
+    Result png, packed, raw;
+    int count = 0;
+
+    for(auto const &entry : entries) {
+        MaskPtr mask = readMask(entry.absoluteFilePath());
+        if(!mask) continue;
+
+        LabelMat labels = mask->dense();
+
+        Result p = benchPng(labels);
+        Result k = benchPacked(*mask);
+
+        Result r = benchRaw(*mask);
+
+        std::cout << entry.fileName().toStdString() << " " << labels.cols << "x" << labels.rows
+                  << " png " << p.bytes << " packed " << k.bytes << std::endl;
+
+        png += p;
+        packed += k;
+        raw += r;
+        ++count;
+    }
+
+    std::cout << std::endl << count << " masks" << std::endl;
+    std::cout << std::setw(8) << "format" << std::setw(12) << "encode ms"
+              << std::setw(12) << "decode ms" << std::setw(14) << "bytes" << std::endl;
+
+    print("png", png);
+    print("packed", packed);
+    print("raw", raw);
+}
@@ -0,0 +1,10 @@
+#ifndef MASKBENCH_H
+#define MASKBENCH_H
+
+#include <QDir>
+
+// Compare encode/decode time and size of PNG against packed and raw masks,
+// for every .mask file in dir. Results are written to stdout.
+void benchmarkMasks(QDir const &dir);
+
+#endif // MASKBENCH_H
@@ -0,0 +1,340 @@
+#include "maskio.h"
+#include "rle.h"
+#include "tiles.h"
+#include "kernels.h"
+
+#include <QFile>
+#include <cstring>
+#include <algorithm>
+
+#include <opencv2/imgcodecs.hpp>
+
+
+namespace {
+
+    char const magic[4] = {'A', 'M', 'S', 'K'};
+    char const packedMagic[4] = {'A', 'M', 'R', 'L'};
+
+    uint16_t const currentVersion = 1;
+    uint16_t const labelDepth = sizeof(label_t);
+
+    // small enough to keep every thread busy on ordinary images
+    int const bandRows = 128;
+    int const packLevel = 1;
+
+
+    // Fletcher style sums over 8 byte words, each row padded to a whole word
+    struct Checksum {
+        Checksum() : a(0), b(0) {}
+
+        void update(void const *row, int n) {
+            uint8_t const *labels = static_cast<uint8_t const*>(row);
+            int i = 0;
+
+            for(; i + 8 <= n; i += 8) {
+                uint64_t w;
+                std::memcpy(&w, labels + i, 8);
+                a += w;
+                b += a;
+            }
+
+            if(i < n) {
+                uint64_t w = 0;
+                std::memcpy(&w, labels + i, n - i);
+                a += w;
+                b += a;
+            }
+        }
+
+        uint64_t value() const {
+            return b ^ ((a << 32) | (a >> 32));
+        }
+
+        uint64_t a, b;
+    };
+
+
+    void putVarint(QByteArray &out, uint32_t v) {
+        while(v >= 0x80) {
+            out.append(char(v | 0x80));
+            v >>= 7;
+        }
+
+        out.append(char(v));
+    }
+
+    bool getVarint(uint8_t const *&p, uint8_t const *end, uint32_t &v) {
+        v = 0;
+
+        for(int shift = 0; p < end && shift < 32; shift += 7) {
+            uint8_t b = *p++;
+            v |= uint32_t(b & 0x7f) << shift;
+
+            if(!(b & 0x80)) return true;
+        }
+
+        return false;
+    }
+
+
+    // Each row as (length, label) pairs which add up to the row width,
+    // labels little endian in labelDepth bytes
+    QByteArray packBand(MaskStore const &mask, int y0, int y1) {
+        std::vector<label_t> buffer(mask.cols);
+        QByteArray out;
+
+        for(int y = y0; y < y1; ++y) {
+            label_t const *labels = mask.row(y, 0, mask.cols, buffer.data());
+
+            for(int x = 0; x < mask.cols; ) {
+                int n = runLength(labels + x, mask.cols - x);
+
+                putVarint(out, n);
+                for(int i = 0; i < labelDepth; ++i) {
+                    out.append(char(labels[x] >> (8 * i)));
+                }
+
+                x += n;
+            }
+        }
+
+        return qCompress(out, packLevel);
+    }
+
+    bool unpackBand(QByteArray const &packed, int cols, int depth, RleMask::Runs *runs, int rows) {
+        QByteArray data = qUncompress(packed);
+
+        uint8_t const *p = reinterpret_cast<uint8_t const*>(data.constData());
+        uint8_t const *end = p + data.size();
+
+        for(int y = 0; y < rows; ++y) {
+            for(int x = 0; x < cols; ) {
+                uint32_t n;
+                if(!getVarint(p, end, n) || n == 0 || n > uint32_t(cols - x) || end - p < depth)
+                    return false;
+
+                int label = 0;
+                for(int i = 0; i < depth; ++i) {
+                    label |= *p++ << (8 * i);
+                }
+
+                x += n;
+                runs[y].push_back(RleMask::Run(x, label_t(label)));
+            }
+        }
+
+        return p == end;
+    }
+
+
+    bool readHeader(QFile &file, RawMaskHeader &header) {
+        return file.read(reinterpret_cast<char*>(&header), sizeof(header)) == sizeof(header)
+                && std::memcmp(header.magic, magic, sizeof(magic)) == 0;
+    }
+}
+
+
+MaskPtr mapRawMask(QString const &path) {
+    // owned by the mask, the mapping lives as long as the file is open
+    auto file = std::make_shared<QFile>(path);
+    RawMaskHeader header;
+
+    if(!file->open(QIODevice::ReadOnly) || !readHeader(*file, header))
+        return MaskPtr();
+
+    // 8 bit masks can be read by 16 bit builds, not the other way around
+    if(header.version != currentVersion || (header.depth != 1 && header.depth != labelDepth))
+        return MaskPtr();
+
+    qint64 size = qint64(header.rows) * header.cols * header.depth;
+    if(size == 0 || file->size() < qint64(sizeof(header)) + size)
+        return MaskPtr();
+
+    uchar *data = file->map(sizeof(header), size);
+    if(!data)
+        return MaskPtr();
+
+    cv::Mat image(header.rows, header.cols, header.depth == 1 ? CV_8U : CV_16U, data);
+
+    Checksum sum;
+    for(int y = 0; y < image.rows; ++y) {
+        sum.update(image.ptr(y), image.cols * header.depth);
+    }
+
+    if(sum.value() != header.checksum)
+        return MaskPtr();
+
+    if(header.depth != labelDepth) {
+        LabelMat wide;
+        image.convertTo(wide, cv::DataType<label_t>::depth);
+
+        return compactMask(wide);
+    }
+
+    return std::make_shared<DenseMask>(LabelMat(image), file);
+}
+
+
+bool writeRawMask(QString const &path, MaskStore const &mask) {
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+
+    RawMaskHeader header;
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = currentVersion;
+    header.depth = labelDepth;
+    header.rows = mask.rows;
+    header.cols = mask.cols;
+    header.checksum = 0;
+
+    // checksum is filled in once the rows are written
+    file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+
+    std::vector<label_t> buffer(mask.cols);
+    Checksum sum;
+
+    for(int y = 0; y < mask.rows; ++y) {
+        label_t const *labels = mask.row(y, 0, mask.cols, buffer.data());
+
+        sum.update(labels, mask.cols * labelDepth);
+        file.write(reinterpret_cast<char const*>(labels), mask.cols * labelDepth);
+    }
+
+    header.checksum = sum.value();
+
+    file.seek(0);
+    file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+
+    return file.error() == QFile::NoError;
+}
+
+
+QByteArray packMask(MaskStore const &mask) {
+    PackedMaskHeader header;
+    std::memcpy(header.magic, packedMagic, sizeof(packedMagic));
+    header.version = currentVersion;
+    header.depth = labelDepth;
+    header.rows = mask.rows;
+    header.cols = mask.cols;
+    header.bandRows = bandRows;
+    header.bands = (mask.rows + bandRows - 1) / bandRows;
+
+    std::vector<QByteArray> bands(header.bands);
+
+    cv::parallel_for_(cv::Range(0, header.bands), [&](cv::Range const &r) {
+        for(int b = r.start; b < r.end; ++b) {
+            int y0 = b * bandRows;
+            bands[b] = packBand(mask, y0, std::min(mask.rows, y0 + bandRows));
+        }
+    });
+
+    QByteArray out(reinterpret_cast<char const*>(&header), sizeof(header));
+
+    for(auto const &band : bands) {
+        uint32_t size = band.size();
+        out.append(reinterpret_cast<char const*>(&size), sizeof(size));
+    }
+
+    for(auto const &band : bands) {
+        out.append(band);
+    }
+
+    return out;
+}
+
+
+MaskPtr unpackMask(QByteArray const &data) {
+    PackedMaskHeader header;
+
+    if(data.size() < int(sizeof(header)))
+        return MaskPtr();
+
+    std::memcpy(&header, data.constData(), sizeof(header));
+
+    if(std::memcmp(header.magic, packedMagic, sizeof(packedMagic)) != 0
+            || header.version != currentVersion || header.depth < 1 || header.depth > labelDepth
+            || header.bandRows == 0 || header.bands != (header.rows + header.bandRows - 1) / header.bandRows)
+        return MaskPtr();
+
+    qint64 offset = sizeof(header) + qint64(header.bands) * sizeof(uint32_t);
+    if(data.size() < offset)
+        return MaskPtr();
+
+    std::vector<QByteArray> bands(header.bands);
+    uint32_t const *sizes = reinterpret_cast<uint32_t const*>(data.constData() + sizeof(header));
+
+    for(uint32_t b = 0; b < header.bands; ++b) {
+        if(data.size() - offset < sizes[b])
+            return MaskPtr();
+
+        bands[b] = QByteArray::fromRawData(data.constData() + offset, sizes[b]);
+        offset += sizes[b];
+    }
+
+    int rows = header.rows, cols = header.cols;
+    std::vector<RleMask::Runs> runs(rows);
+    std::vector<char> valid(header.bands);
+
+    cv::parallel_for_(cv::Range(0, header.bands), [&](cv::Range const &r) {
+        for(int b = r.start; b < r.end; ++b) {
+            int y0 = b * header.bandRows;
+            int n = std::min<int>(rows - y0, header.bandRows);
+
+            valid[b] = unpackBand(bands[b], cols, header.depth, runs.data() + y0, n);
+        }
+    });
+
+    if(std::find(valid.begin(), valid.end(), false) != valid.end())
+        return MaskPtr();
+
+    auto mask = std::make_shared<RleMask>(rows, cols, std::move(runs));
+
+    // noisy masks are cheaper as tiles than as runs
+    if(mask->bytes() > 2 * size_t(rows) * cols) {
+        return std::make_shared<TileMask>(*mask);
+    }
+
+    return mask;
+}
+
+
+bool writePackedMask(QString const &path, MaskStore const &mask) {
+    QFile file(path);
+
+    return file.open(QIODevice::WriteOnly)
+            && file.write(packMask(mask)) >= 0
+            && file.error() == QFile::NoError;
+}
+
+
+MaskPtr readMask(QString const &path) {
+    MaskPtr mask = mapRawMask(path);
+    if(mask) return mask;
+
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return MaskPtr();
+
+    if(file.peek(sizeof(packedMagic)) == QByteArray(packedMagic, sizeof(packedMagic))) {
+        return unpackMask(file.readAll());
+    }
+
+    LabelMat image = readMaskImage(path);
+    return image.empty() ? MaskPtr() : compactMask(image);
+}
+
+
+LabelMat readMaskImage(QString const &path) {
+    cv::Mat image = cv::imread(path.toStdString(), cv::IMREAD_UNCHANGED);
+
+    if(image.channels() > 1) {
+        cv::extractChannel(image, image, 0);
+    }
+
+    if(image.depth() != cv::DataType<label_t>::depth) {
+        image.convertTo(image, cv::DataType<label_t>::depth);
+    }
+
+    return image;
+}
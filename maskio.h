@@ -0,0 +1,57 @@
+#ifndef MASKIO_H
+#define MASKIO_H
+
+#include <QString>
+#include <QByteArray>
+
+#include "mask.h"
+
+
+// Raw .mask container, a fixed header followed by the labels row by row.
+// Loading maps the file rather than decoding it, PNG masks are still read.
+// Masks are written with the depth of label_t, narrower ones are widened on load.
+struct RawMaskHeader {
+    char magic[4];          // "AMSK"
+    uint16_t version;
+    uint16_t depth;         // bytes per label
+    uint32_t rows, cols;
+    uint64_t checksum;      // of the labels, see Checksum in maskio.cpp
+};
+
+static_assert(sizeof(RawMaskHeader) == 24, "raw mask header must be packed");
+
+
+// Labels mapped from a raw mask, copied on first write. Null if the file
+// isn't a raw mask, is truncated or fails its checksum.
+MaskPtr mapRawMask(QString const &path);
+
+bool writeRawMask(QString const &path, MaskStore const &mask);
+
+
+// Packed masks hold each row as runs, deflated in bands of rows which are
+// encoded and decoded in parallel. Decoding gives run length encoded labels.
+struct PackedMaskHeader {
+    char magic[4];          // "AMRL"
+    uint16_t version;
+    uint16_t depth;
+    uint32_t rows, cols;
+    uint32_t bandRows;
+    uint32_t bands;         // followed by the size of each band, then the bands
+};
+
+static_assert(sizeof(PackedMaskHeader) == 24, "packed mask header must be packed");
+
+QByteArray packMask(MaskStore const &mask);
+MaskPtr unpackMask(QByteArray const &data);
+
+bool writePackedMask(QString const &path, MaskStore const &mask);
+
+
+// Labels from any mask file: raw masks are mapped, packed masks unpacked and
+// anything else decoded as an image. Null if there is no usable mask.
+MaskPtr readMask(QString const &path);
+
+// Single channel image, from the first channel of a colour image
+LabelMat readMaskImage(QString const &path);
+
+#endif // MASKIO_H
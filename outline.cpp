@@ -0,0 +1,127 @@
+#include "outline.h"
+
+#include <algorithm>
+
+
+Outlines::Outlines()
+    : layer(nullptr), version(-1), columns(0) {
+}
+
+void Outlines::reset() {
+    tiles.clear();
+
+    layer = nullptr;
+    version = -1;
+
+    size = cv::Size();
+    columns = 0;
+}
+
+
+void Outlines::update(Layer const &layer_, cv::Rect const &region) {
+    cv::Rect bounds(cv::Point(), layer_.size());
+
+    if(layer != &layer_ || size != bounds.size()) {
+        reset();
+
+        layer = &layer_;
+        size = bounds.size();
+
+        columns = (size.width + tileSize - 1) / tileSize;
+        tiles.resize(columns * ((size.height + tileSize - 1) / tileSize));
+
+    } else {
+        cv::Rect dirty = layer_.changedSince(version);
+
+        // an edit also changes the edges of the pixels left of and above it
+        if(dirty.area()) {
+            dirty = cv::Rect(dirty.x - 1, dirty.y - 1, dirty.width + 1, dirty.height + 1) & bounds;
+
+            for(int ty = dirty.y / tileSize; ty <= (dirty.br().y - 1) / tileSize; ++ty) {
+                for(int tx = dirty.x / tileSize; tx <= (dirty.br().x - 1) / tileSize; ++tx) {
+                    tiles[ty * columns + tx] = Tile();
+                }
+            }
+        }
+    }
+
+    version = layer_.getVersion();
+
+    cv::Rect r = region & bounds;
+    if(r.area() == 0)
+        return;
+
+    std::vector<cv::Point> missing;
+
+    for(int ty = r.y / tileSize; ty <= (r.br().y - 1) / tileSize; ++ty) {
+        for(int tx = r.x / tileSize; tx <= (r.br().x - 1) / tileSize; ++tx) {
+            if(!tiles[ty * columns + tx].found) missing.push_back(cv::Point(tx, ty));
+        }
+    }
+
+    cv::parallel_for_(cv::Range(0, int(missing.size())), [&](cv::Range const &range) {
+        for(int i = range.start; i < range.end; ++i) {
+            find(layer_, missing[i].x, missing[i].y);
+        }
+    });
+}
+
+
+void Outlines::find(Layer const &layer, int tx, int ty) {
+    cv::Rect bounds(cv::Point(), size);
+    cv::Rect r = cv::Rect(tx * tileSize, ty * tileSize, tileSize, tileSize) & bounds;
+
+    // with the column and row after, for the edges of the last ones
+    LabelMat labels = layer.getRegion(cv::Rect(r.x, r.y, r.width + 1, r.height + 1) & bounds);
+
+    cv::Mat1b edges(r.size(), uint8_t(0));
+    uint8_t any = 0;
+
+    for(int y = 0; y < r.height; ++y) {
+        label_t const *l = labels.ptr<label_t>(y);
+        uint8_t *e = edges.ptr(y);
+
+        int n = std::min(r.width, labels.cols - 1);
+        for(int x = 0; x < n; ++x) {
+            e[x] = l[x] != l[x + 1] ? uint8_t(right) : 0;
+        }
+
+        if(y + 1 < labels.rows) {
+            label_t const *next = labels.ptr<label_t>(y + 1);
+
+            for(int x = 0; x < r.width; ++x) {
+                e[x] |= l[x] != next[x] ? uint8_t(below) : 0;
+            }
+        }
+
+        for(int x = 0; x < r.width; ++x) {
+            any |= e[x];
+        }
+    }
+
+    Tile &tile = tiles[ty * columns + tx];
+
+    tile.edges = any ? edges : cv::Mat1b();
+    tile.found = true;
+}
+
+
+void Outlines::row(int y, int x0, int x1, uint8_t *dst) const {
+    int ty = y / tileSize;
+
+    for(int x = x0; x < x1; ) {
+        int tx = x / tileSize;
+        int end = std::min(x1, (tx + 1) * tileSize);
+
+        Tile const &tile = tiles[ty * columns + tx];
+
+        if(tile.edges.empty()) {
+            std::fill(dst + x - x0, dst + end - x0, 0);
+        } else {
+            uint8_t const *e = tile.edges.ptr(y - ty * tileSize) - tx * tileSize;
+            std::copy(e + x, e + end, dst + x - x0);
+        }
+
+        x = end;
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef OUTLINE_H
+#define OUTLINE_H
+
+#include <vector>
+
+#include "opencv2/core.hpp"
+
+#include "layer.h"
+
+
+// Where the labels of a layer change between neighbouring pixels, for drawing
+// a layer as outlines. Kept in tiles which are found when first needed, and
+// again only once an edit of the layer has touched them.
+class Outlines {
+
+public:
+    enum { tileSize = 256 };
+
+    // Edge bits of a pixel, its label differs from the one to the right or below
+    enum { right = 1, below = 2 };
+
+    Outlines();
+
+    // Bring up to date with the layer, finding any missing tiles under region
+    void update(Layer const &layer, cv::Rect const &region);
+    void reset();
+
+    // Edge bits of [x0, x1) of row y, which must be inside the last region
+    void row(int y, int x0, int x1, uint8_t *dst) const;
+
+    uint8_t at(int x, int y) const {
+        Tile const &tile = tiles[(y / tileSize) * columns + x / tileSize];
+        return tile.edges.empty() ? 0 : tile.edges(y % tileSize, x % tileSize);
+    }
+
+private:
+    struct Tile {
+        Tile() : found(false) {}
+
+        bool found;
+        cv::Mat1b edges;   // empty if there are none
+    };
+
+    void find(Layer const &layer, int tx, int ty);
+
+    Layer const *layer;
+    int version;
+
+    cv::Size size;
+    int columns;
+
+    std::vector<Tile> tiles;
+};
+
+#endif // OUTLINE_H
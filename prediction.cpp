@@ -0,0 +1,21 @@
+#include "prediction.h"
+#include "kernels.h"
+
+
+void predictLabels(std::vector<cv::Mat1b> const &probs, std::vector<int> const &bias,
+                   int threshold, int reject, cv::Rect const &r, LabelMat &labels) {
+    labels.create(r.size());
+    int classes = int(probs.size());
+
+    cv::parallel_for_(cv::Range(0, r.height), [&](cv::Range const &rows) {
+        std::vector<uint8_t const*> planes(classes);
+
+        for(int y = rows.start; y < rows.end; ++y) {
+            for(int c = 0; c < classes; ++c) {
+                planes[c] = probs[c].ptr(r.y + y) + r.x;
+            }
+
+            argmaxLabels(planes.data(), bias.data(), classes, threshold, reject, labels.ptr<label_t>(y), r.width);
+        }
+    }, std::max(1.0, r.area() / 65536.0));
+}
@@ -0,0 +1,15 @@
+#ifndef PREDICTION_H
+#define PREDICTION_H
+
+#include <vector>
+
+#include "opencv2/core.hpp"
+#include "labels.h"
+
+
+// Labels of r from per-class probability planes: the class with the highest
+// probability plus its bias, or reject where that is below threshold (0-255)
+void predictLabels(std::vector<cv::Mat1b> const &probs, std::vector<int> const &bias,
+                   int threshold, int reject, cv::Rect const &r, LabelMat &labels);
+
+#endif // PREDICTION_H
@@ -0,0 +1,118 @@
+#include "raster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+inline void discSpan(Point const &c, float y, float &lo, float &hi) {
+    float dy = y - c.p.y;
+    float d2 = c.r * c.r - dy * dy;
+
+    if(d2 >= 0) {
+        float h = std::sqrt(d2);
+        lo = std::min(lo, c.p.x - h);
+        hi = std::max(hi, c.p.x + h);
+    }
+}
+
+inline void segmentSpan(cv::Point2f const &p, cv::Point2f const &q, float y, float &lo, float &hi) {
+    if(y < std::min(p.y, q.y) || y > std::max(p.y, q.y))
+        return;
+
+    if(p.y == q.y) {
+        lo = std::min(lo, std::min(p.x, q.x));
+        hi = std::max(hi, std::max(p.x, q.x));
+    } else {
+        float x = p.x + (y - p.y) * (q.x - p.x) / (q.y - p.y);
+        lo = std::min(lo, x);
+        hi = std::max(hi, x);
+    }
+}
+
+
+void capsuleSpans(Point const &a, Point const &b, cv::Size const &size, Spans &spans) {
+
+    cv::Point2f d = b.p - a.p;
+    float dist = std::sqrt(d.dot(d));
+
+    // Outer tangents touch each disc at p + r * n, where n.(b - a) = (ra - rb)
+    // they only exist when neither disc contains the other.
+    bool tangents = dist > std::abs(a.r - b.r);
+    cv::Point2f ta[2], tb[2];
+
+    if(tangents) {
+        cv::Point2f u = d / dist;
+        cv::Point2f perp(-u.y, u.x);
+
+        float k = (a.r - b.r) / dist;
+        float s = std::sqrt(1.0f - k * k);
+
+        for(int i = 0; i < 2; ++i) {
+            cv::Point2f n = u * k + perp * (i ? s : -s);
+
+            ta[i] = a.p + n * a.r;
+            tb[i] = b.p + n * b.r;
+        }
+    }
+
+    int y0 = std::max<int>(0, std::ceil(std::min(a.p.y - a.r, b.p.y - b.r)));
+    int y1 = std::min<int>(size.height - 1, std::floor(std::max(a.p.y + a.r, b.p.y + b.r)));
+
+    for(int y = y0; y <= y1; ++y) {
+        float lo = std::numeric_limits<float>::max();
+        float hi = -lo;
+
+        discSpan(a, y, lo, hi);
+        discSpan(b, y, lo, hi);
+
+        if(tangents) {
+            segmentSpan(ta[0], tb[0], y, lo, hi);
+            segmentSpan(ta[1], tb[1], y, lo, hi);
+        }
+
+        if(lo <= hi) {
+            int x0 = std::max<int>(0, std::ceil(lo));
+            int x1 = std::min<int>(size.width, std::floor(hi) + 1);
+
+            if(x0 < x1) spans.push_back(Span(y, x0, x1));
+        }
+    }
+}
+
+
+void mergeSpans(Spans &spans) {
+    std::sort(spans.begin(), spans.end(), [](Span const &s, Span const &t) {
+        return s.y < t.y || (s.y == t.y && s.x0 < t.x0);
+    });
+
+    size_t n = 0;
+    for(size_t i = 0; i < spans.size(); ++i) {
+        Span const &s = spans[i];
+
+        if(n > 0 && spans[n - 1].y == s.y && s.x0 <= spans[n - 1].x1) {
+            spans[n - 1].x1 = std::max(spans[n - 1].x1, s.x1);
+        } else {
+            spans[n++] = s;
+        }
+    }
+
+    spans.resize(n);
+}
+
+
+Spans strokeSpans(std::vector<Point> const &points, cv::Size const &size) {
+    Spans spans;
+
+    if(points.size() == 1) {
+        capsuleSpans(points[0], points[0], size, spans);
+    }
+
+    for(size_t i = 1; i < points.size(); ++i) {
+        capsuleSpans(points[i - 1], points[i], size, spans);
+    }
+
+    mergeSpans(spans);
+    return spans;
+}
+
@@ -0,0 +1,33 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <vector>
+
+#include "opencv2/core.hpp"
+#include "state.h"
+
+// A horizontal run of pixels [x0, x1) on row y
+struct Span {
+    Span(int y, int x0, int x1)
+        : y(y), x0(x0), x1(x1) {}
+
+    Span() : y(0), x0(0), x1(0) {}
+
+    int y;
+    int x0, x1;
+};
+
+typedef std::vector<Span> Spans;
+
+
+// Spans covered by a brush swept between two points (the convex hull of both discs),
+// one span per row, clipped to size.
+void capsuleSpans(Point const &a, Point const &b, cv::Size const &size, Spans &spans);
+
+// Sort by row and merge overlapping spans, so every pixel is covered at most once.
+void mergeSpans(Spans &spans);
+
+// Spans for a polyline of brush samples (or a single dab), already merged.
+Spans strokeSpans(std::vector<Point> const &points, cv::Size const &size);
+
+#endif // RASTER_H
@@ -0,0 +1,241 @@
+#include "rle.h"
+#include "raster.h"
+#include "kernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+template<typename Runs>
+inline void appendRun(Runs &runs, int end, int label) {
+    if(!runs.empty() && runs.back().label == label) {
+        runs.back().end = end;
+    } else {
+        runs.push_back(typename Runs::value_type(end, label));
+    }
+}
+
+template<typename T, typename Runs>
+inline void encodeRow(T const *labels, int x0, int x1, Runs &runs) {
+    for(int x = x0; x < x1; ) {
+        int end = x + runLength(labels + (x - x0), x1 - x);
+
+        appendRun(runs, end, labels[x - x0]);
+        x = end;
+    }
+}
+
+// First run ending after x
+template<typename Runs>
+inline typename Runs::const_iterator findRun(Runs const &runs, int x) {
+    return std::upper_bound(runs.begin(), runs.end(), x, [](int x, typename Runs::value_type const &run) {
+        return x < run.end;
+    });
+}
+
+template<typename Runs>
+inline int runStart(Runs const &runs, typename Runs::const_iterator i) {
+    return i == runs.begin() ? 0 : (i - 1)->end;
+}
+
+
+template<typename T>
+RleMask_<T>::RleMask_(int rows, int cols, int label)
+    : MaskStore_<T>(rows, cols), runs(rows, Runs(1, Run(cols, label))) {
+}
+
+template<typename T>
+RleMask_<T>::RleMask_(Labels const &image)
+    : MaskStore_<T>(image.rows, image.cols), runs(image.rows) {
+
+    for(int y = 0; y < image.rows; ++y) {
+        encodeRow(image.template ptr<T>(y), 0, image.cols, runs[y]);
+    }
+}
+
+template<typename T>
+RleMask_<T>::RleMask_(int rows, int cols, std::vector<Runs> &&runs)
+    : MaskStore_<T>(rows, cols), runs(std::move(runs)) {
+}
+
+
+template<typename T>
+T const *RleMask_<T>::row(int y, int x0, int x1, T *buffer) const {
+    Runs const &r = runs[y];
+
+    int x = x0;
+    for(auto i = findRun(r, x0); x < x1; ++i) {
+        int end = std::min(i->end, x1);
+        std::fill(buffer + (x - x0), buffer + (end - x0), T(i->label));
+
+        x = end;
+    }
+
+    return buffer;
+}
+
+
+template<typename T>
+bool RleMask_<T>::uniform(int y, int x0, int x1, int &label) const {
+    auto i = findRun(runs[y], x0);
+    label = i->label;
+
+    return i->end >= x1;
+}
+
+
+template<typename T>
+void RleMask_<T>::splice(int y, int x0, int x1, Runs const &replacement) {
+    Runs const &r = runs[y];
+
+    Runs out;
+    out.reserve(r.size() + replacement.size() + 1);
+
+    auto i = r.begin();
+    for(; i != r.end() && i->end <= x0; ++i) {
+        out.push_back(*i);
+    }
+
+    // the run straddling x0 keeps its head
+    if(i != r.end() && runStart(r, i) < x0) {
+        appendRun(out, x0, i->label);
+    }
+
+    for(auto const &run : replacement) {
+        appendRun(out, run.end, run.label);
+    }
+
+    while(i != r.end() && i->end <= x1) ++i;
+
+    for(; i != r.end(); ++i) {
+        appendRun(out, i->end, i->label);
+    }
+
+    runs[y].swap(out);
+}
+
+
+template<typename T>
+void RleMask_<T>::fillSpan(int y, int x0, int x1, int label) {
+    if(x0 < x1) {
+        splice(y, x0, x1, Runs(1, Run(x1, label)));
+    }
+}
+
+template<typename T>
+void RleMask_<T>::writeRow(int y, int x0, int x1, T const *labels) {
+    if(x0 < x1) {
+        Runs replacement;
+        encodeRow(labels, x0, x1, replacement);
+
+        splice(y, x0, x1, replacement);
+    }
+}
+
+
+template<typename T>
+int RleMask_<T>::floodFill(cv::Point const &seed, int label, cv::Rect *rect) {
+    int const rows = this->rows, cols = this->cols;
+
+    int target = this->at(seed.x, seed.y);
+    if(rect) *rect = cv::Rect();
+
+    if(target == label)
+        return 0;
+
+    // every pixel of a run shares its label, so the fill visits whole runs
+    int area = 0;
+    int left = cols, top = rows, right = 0, bottom = 0;
+
+    Spans stack, found;
+
+    auto fill = [&](Span const &s) {
+        fillSpan(s.y, s.x0, s.x1, label);
+        stack.push_back(s);
+
+        area += s.x1 - s.x0;
+        left = std::min(left, s.x0);
+        right = std::max(right, s.x1);
+        top = std::min(top, s.y);
+        bottom = std::max(bottom, s.y + 1);
+    };
+
+    Runs const &r = runs[seed.y];
+    auto i = findRun(r, seed.x);
+    fill(Span(seed.y, runStart(r, i), i->end));
+
+    while(!stack.empty()) {
+        Span s = stack.back();
+        stack.pop_back();
+
+        for(int y : {s.y - 1, s.y + 1}) {
+            if(y < 0 || y >= rows) continue;
+
+            Runs const &neighbour = runs[y];
+            found.clear();
+
+            for(auto j = findRun(neighbour, s.x0); j != neighbour.end(); ++j) {
+                int start = runStart(neighbour, j);
+                if(start >= s.x1) break;
+
+                if(j->label == target) {
+                    found.push_back(Span(y, start, j->end));
+                }
+            }
+
+            for(auto const &f : found) fill(f);
+        }
+    }
+
+    if(rect) *rect = cv::Rect(left, top, right - left, bottom - top);
+    return area;
+}
+
+
+template<typename T>
+size_t RleMask_<T>::runCount() const {
+    size_t n = 0;
+    for(auto const &r : runs) {
+        n += r.size();
+    }
+
+    return n;
+}
+
+template<typename T>
+size_t RleMask_<T>::bytes() const {
+    size_t n = sizeof(*this) + runs.size() * sizeof(Runs);
+    for(auto const &r : runs) {
+        n += r.capacity() * sizeof(Run);
+    }
+
+    return n;
+}
+
+
+template<typename T>
+typename MaskStore_<T>::Ptr encodeMask(cv::Mat_<T> const &image) {
+    auto runs = std::make_shared<RleMask_<T>>(image);
+
+    if(runs->bytes() * 4 > image.total() * sizeof(T)) {
+        return typename MaskStore_<T>::Ptr();
+    }
+
+    return runs;
+}
+
+template<typename T>
+typename MaskStore_<T>::Ptr compactMask(cv::Mat_<T> const &image) {
+    typename MaskStore_<T>::Ptr runs = encodeMask(image);
+    return runs ? runs : std::make_shared<DenseMask_<T>>(image);
+}
+
+
+template class RleMask_<uint8_t>;
+template class RleMask_<uint16_t>;
+
+template MaskStore_<uint8_t>::Ptr encodeMask(cv::Mat_<uint8_t> const &image);
+template MaskStore_<uint16_t>::Ptr encodeMask(cv::Mat_<uint16_t> const &image);
+
+template MaskStore_<uint8_t>::Ptr compactMask(cv::Mat_<uint8_t> const &image);
+template MaskStore_<uint16_t>::Ptr compactMask(cv::Mat_<uint16_t> const &image);
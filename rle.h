@@ -0,0 +1,68 @@
+#ifndef RLE_H
+#define RLE_H
+
+#include <vector>
+
+#include "mask.h"
+
+
+// Labels stored as runs per row. Flat masks (the refine layer, most
+// predictions) cost a few runs per row, and fills, rectangle clears and
+// flood fills work directly on the runs.
+template<typename T>
+class RleMask_ : public MaskStore_<T> {
+
+public:
+    typedef typename MaskStore_<T>::Ptr Ptr;
+    typedef typename MaskStore_<T>::Labels Labels;
+
+    struct Run {
+        Run(int end, int label)
+            : end(end), label(label) {}
+
+        int end;    // the run starts where the previous one ends
+        int label;
+    };
+
+    typedef std::vector<Run> Runs;
+
+
+    RleMask_(int rows, int cols, int label);
+    RleMask_(Labels const &image);
+    RleMask_(int rows, int cols, std::vector<Runs> &&runs);
+
+    T const *row(int y, int x0, int x1, T *buffer) const;
+
+    void fillSpan(int y, int x0, int x1, int label);
+    void writeRow(int y, int x0, int x1, T const *labels);
+
+    int floodFill(cv::Point const &seed, int label, cv::Rect *rect = nullptr);
+    bool uniform(int y, int x0, int x1, int &label) const;
+
+    Ptr snapshot() const { return clone(); }
+    Ptr clone() const { return std::make_shared<RleMask_>(*this); }
+
+    size_t bytes() const;
+    size_t runCount() const;
+
+    Runs const &runsOf(int y) const { return runs[y]; }
+
+private:
+    void splice(int y, int x0, int x1, Runs const &replacement);
+
+    std::vector<Runs> runs;
+};
+
+
+typedef RleMask_<label_t> RleMask;
+
+
+// Run length encoded copy of image, or null if it doesn't compress well
+template<typename T>
+typename MaskStore_<T>::Ptr encodeMask(cv::Mat_<T> const &image);
+
+// Run length encoded if that pays, otherwise image itself
+template<typename T>
+typename MaskStore_<T>::Ptr compactMask(cv::Mat_<T> const &image);
+
+#endif // RLE_H
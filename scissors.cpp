@@ -0,0 +1,201 @@
+#include "scissors.h"
+
+#include <climits>
+#include <cstdlib>
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+
+namespace {
+
+    // margin read around a tile for the filters
+    int const filterMargin = 4;
+
+    int const none = 255;
+
+    int const dx[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+    int const dy[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+
+
+    // straight line from a to b inclusive
+    std::vector<cv::Point> line(cv::Point const &a, cv::Point const &b) {
+        std::vector<cv::Point> points;
+        int n = std::max(std::abs(b.x - a.x), std::abs(b.y - a.y));
+
+        for(int i = 0; i <= n; ++i) {
+            float t = n ? float(i) / n : 0.0f;
+            points.push_back(cv::Point(cvRound(a.x + (b.x - a.x) * t), cvRound(a.y + (b.y - a.y) * t)));
+        }
+
+        return points;
+    }
+
+
+    cv::Mat1b tileCost(ImageSource const &source, cv::Rect const &tile) {
+        cv::Rect bounds(cv::Point(), source.size());
+        cv::Rect r = cv::Rect(tile.x - filterMargin, tile.y - filterMargin,
+                              tile.width + 2 * filterMargin, tile.height + 2 * filterMargin) & bounds;
+
+        cv::Mat4b pixels;
+        source.read(r, pixels);
+
+        cv::Mat1b grey;
+        cv::cvtColor(pixels, grey, cv::COLOR_BGRA2GRAY);
+        cv::GaussianBlur(grey, grey, cv::Size(), 1);
+
+        cv::Mat1f gx, gy, magnitude;
+        cv::Sobel(grey, gx, CV_32F, 1, 0);
+        cv::Sobel(grey, gy, CV_32F, 0, 1);
+        cv::magnitude(gx, gy, magnitude);
+
+        // strong edges are cheap, 1 at the least so every step costs something
+        cv::Mat1b c;
+        magnitude.convertTo(c, CV_8U, -0.5, 255);
+        cv::max(c, 1, c);
+
+        return c(tile - r.tl()).clone();
+    }
+}
+
+
+cv::Mat1b EdgeCosts::region(cv::Rect const &r) {
+    cv::Rect bounds(cv::Point(), size());
+    cv::Rect window = r & bounds;
+
+    if(window.area() == 0)
+        return cv::Mat1b();
+
+    uint64_t stamp = ++uses;
+
+    cv::Point t0(window.x / tileSize, window.y / tileSize);
+    cv::Point t1((window.br().x - 1) / tileSize, (window.br().y - 1) / tileSize);
+
+    std::vector<cv::Rect> missing;
+    for(int ty = t0.y; ty <= t1.y; ++ty) {
+        for(int tx = t0.x; tx <= t1.x; ++tx) {
+            auto i = tiles.find(std::make_pair(tx, ty));
+
+            if(i != tiles.end()) {
+                i->second.used = stamp;
+            } else {
+                missing.push_back(cv::Rect(tx * tileSize, ty * tileSize, tileSize, tileSize) & bounds);
+            }
+        }
+    }
+
+    std::vector<cv::Mat1b> computed(missing.size());
+    cv::parallel_for_(cv::Range(0, int(missing.size())), [&](cv::Range const &range) {
+        for(int i = range.start; i < range.end; ++i) {
+            computed[i] = tileCost(*source, missing[i]);
+        }
+    });
+
+    for(size_t i = 0; i < missing.size(); ++i) {
+        auto key = std::make_pair(missing[i].x / tileSize, missing[i].y / tileSize);
+        tiles[key] = Tile {computed[i], stamp};
+    }
+
+    // least recently used go, never those of this window
+    while(tiles.size() > size_t(maxTiles)) {
+        auto oldest = std::min_element(tiles.begin(), tiles.end(), [](TileEntry const &a, TileEntry const &b) {
+            return a.second.used < b.second.used;
+        });
+
+        if(oldest->second.used == stamp) break;
+        tiles.erase(oldest);
+    }
+
+    cv::Mat1b cost(window.size());
+    for(int ty = t0.y; ty <= t1.y; ++ty) {
+        for(int tx = t0.x; tx <= t1.x; ++tx) {
+            cv::Point tl(tx * tileSize, ty * tileSize);
+            cv::Rect part = cv::Rect(tl, cv::Size(tileSize, tileSize)) & window;
+
+            tiles[std::make_pair(tx, ty)].cost(part - tl).copyTo(cost(part - window.tl()));
+        }
+    }
+
+    return cost;
+}
+
+
+
+LiveWire::LiveWire(CostPtr const &costs, cv::Point const &anchor)
+    : costs(costs), anchor(anchor) {
+}
+
+
+void LiveWire::restart(cv::Rect const &window_) {
+    window = window_;
+    cost = costs->region(window);
+
+    dist = cv::Mat1i(window.size(), INT_MAX);
+    from = cv::Mat1b(window.size(), uint8_t(none));
+    queue = decltype(queue)();
+
+    cv::Point a = anchor - window.tl();
+    dist(a) = 0;
+    queue.push(Entry(0, a.y * window.width + a.x));
+}
+
+
+std::vector<cv::Point> LiveWire::path(cv::Point const &p) {
+    cv::Rect bounds(cv::Point(), costs->size());
+    if(!bounds.contains(p) || !bounds.contains(anchor))
+        return std::vector<cv::Point>();
+
+    if(!window.contains(p)) {
+        cv::Point tl(std::min(anchor.x, p.x) - margin, std::min(anchor.y, p.y) - margin);
+        cv::Point br(std::max(anchor.x, p.x) + margin + 1, std::max(anchor.y, p.y) + margin + 1);
+
+        cv::Rect r = cv::Rect(tl, br) & bounds;
+        if(r.width > maxSide || r.height > maxSide)
+            return line(anchor, p);
+
+        restart(r);
+    }
+
+    cv::Point target = p - window.tl();
+
+    // Dijkstra, until nothing left to settle is closer than the target
+    while(!queue.empty() && queue.top().first < dist(target)) {
+        Entry e = queue.top();
+        queue.pop();
+
+        int x = e.second % window.width, y = e.second / window.width;
+        if(e.first > dist(y, x))
+            continue;
+
+        for(int d = 0; d < 8; ++d) {
+            int u = x + dx[d], v = y + dy[d];
+            if(u < 0 || v < 0 || u >= window.width || v >= window.height)
+                continue;
+
+            // diagonal steps cost about sqrt(2) as much
+            int step = (d & 1) ? (cost(v, u) * 3 + 1) / 2 : cost(v, u);
+            int n = e.first + step;
+
+            if(n < dist(v, u)) {
+                dist(v, u) = n;
+                from(v, u) = uint8_t((d + 4) % 8);
+                queue.push(Entry(n, v * window.width + u));
+            }
+        }
+    }
+
+    std::vector<cv::Point> points;
+    cv::Point q = target;
+
+    while(true) {
+        points.push_back(q + window.tl());
+
+        int d = from(q);
+        if(d == none) break;
+
+        q = cv::Point(q.x + dx[d], q.y + dy[d]);
+    }
+
+    std::reverse(points.begin(), points.end());
+    return points;
+}
@@ -0,0 +1,79 @@
+#ifndef SCISSORS_H
+#define SCISSORS_H
+
+#include <map>
+#include <memory>
+#include <queue>
+#include <vector>
+
+#include "opencv2/core.hpp"
+
+#include "source.h"
+
+
+// Cost of a path through each pixel for intelligent scissors, low on strong
+// edges. Computed only where the live wire reaches, a tile at a time in
+// parallel, and kept for the most recently used tiles.
+class EdgeCosts {
+
+public:
+    // enough tiles for the largest live wire window
+    enum { tileSize = 256, maxTiles = 256 };
+
+    EdgeCosts(SourcePtr const &source) : source(source), uses(0) {}
+
+    cv::Size size() const { return source->size(); }
+
+    // Costs of the part of r within the image
+    cv::Mat1b region(cv::Rect const &r);
+
+private:
+    struct Tile {
+        cv::Mat1b cost;
+        uint64_t used;
+    };
+
+    typedef std::pair<std::pair<int, int> const, Tile> TileEntry;
+
+    SourcePtr source;
+
+    std::map<std::pair<int, int>, Tile> tiles;
+    uint64_t uses;
+};
+
+typedef std::shared_ptr<EdgeCosts> CostPtr;
+
+
+// Least cost paths over an edge cost map from an anchor, searched lazily:
+// pixels are settled only as far as needed to reach the points asked for
+// and kept for the next one, so following the cursor costs little. The
+// search is confined to a window around the anchor and the points asked
+// for, which is widened (restarting the search) when a point leaves it.
+class LiveWire {
+
+public:
+    enum { margin = 64, maxSide = 2048 };
+
+    LiveWire(CostPtr const &costs, cv::Point const &anchor);
+
+    // Path from the anchor to p inclusive, a straight line if p is too far away
+    std::vector<cv::Point> path(cv::Point const &p);
+
+    cv::Point getAnchor() const { return anchor; }
+
+private:
+    void restart(cv::Rect const &window);
+
+    CostPtr costs;
+    cv::Point anchor;
+
+    cv::Rect window;
+    cv::Mat1b cost;     // of the window
+    cv::Mat1i dist;
+    cv::Mat1b from;     // direction to the previous pixel on the path, none for unreached
+
+    typedef std::pair<int, int> Entry;  // (distance, index in window)
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+};
+
+#endif // SCISSORS_H
@@ -0,0 +1,95 @@
+#include "source.h"
+#include "tiffsource.h"
+#include "compressedsource.h"
+
+#include <QFileInfo>
+#include <QImageReader>
+#include <cmath>
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+
+void ImageSource::readScaled(cv::Rect const &r, cv::Size const &size, cv::Mat4b &dst) const {
+    cv::Mat4b src;
+    read(r, src);
+
+    dst = cv::Mat4b();
+    cv::resize(src, dst, size, 0, 0, cv::INTER_AREA);
+}
+
+
+void PreviewSource::readScaled(cv::Rect const &r, cv::Size const &size, cv::Mat4b &dst) const {
+    float sx = float(preview.cols) / full.width;
+    float sy = float(preview.rows) / full.height;
+
+    cv::Rect roi(cv::Point(std::floor(r.x * sx), std::floor(r.y * sy)),
+                 cv::Point(std::ceil(r.br().x * sx), std::ceil(r.br().y * sy)));
+    roi &= cv::Rect(0, 0, preview.cols, preview.rows);
+
+    dst = cv::Mat4b();
+    if(roi.area() == 0) {
+        dst = cv::Mat4b(size, cv::Vec4b(0, 0, 0, 255));
+        return;
+    }
+
+    cv::resize(preview(roi), dst, size, 0, 0, cv::INTER_LINEAR);
+}
+
+
+QImage decodeImage(QString const &path, QSize const &scaled, size_t &copied) {
+    QImageReader reader(path);
+    reader.setAutoTransform(true);    // EXIF orientation, as cv::imread
+
+    if(scaled.isValid()) {
+        reader.setScaledSize(scaled);
+    }
+
+    QImage image;
+    if(reader.read(&image)) {
+        if(image.format() != QImage::Format_RGB32) {
+            image = image.convertToFormat(QImage::Format_RGB32);
+            copied += size_t(image.bytesPerLine()) * image.height();
+        }
+
+        return image;
+    }
+
+    // formats Qt has no plugin for, converted into the QImage's buffer
+    cv::Mat3b bgr = cv::imread(path.toStdString(), cv::IMREAD_COLOR);
+    if(bgr.empty())
+        return QImage();
+
+    if(scaled.isValid()) {
+        cv::resize(bgr, bgr, cv::Size(scaled.width(), scaled.height()), 0, 0, cv::INTER_AREA);
+    }
+
+    image = QImage(bgr.cols, bgr.rows, QImage::Format_RGB32);
+
+    cv::Mat4b pixels(image.height(), image.width(), reinterpret_cast<cv::Vec4b*>(image.bits()), image.bytesPerLine());
+    cv::cvtColor(bgr, pixels, cv::COLOR_BGR2BGRA);
+
+    copied += size_t(image.bytesPerLine()) * image.height();
+    return image;
+}
+
+
+SourcePtr openImage(QString const &path, size_t &copied) {
+    QString suffix = QFileInfo(path).suffix().toLower();
+
+    if(suffix == "tif" || suffix == "tiff") {
+        SourcePtr tiled = TiffSource::open(path);
+        if(tiled) return tiled;
+    }
+
+    QImage image = decodeImage(path, QSize(), copied);
+    if(image.isNull())
+        return SourcePtr();
+
+    // images larger than the tile cache are kept compressed
+    if(size_t(image.bytesPerLine()) * image.height() > CompressedSource::defaultCache) {
+        return std::make_shared<CompressedSource>(matView(image));
+    }
+
+    return std::make_shared<BufferSource>(image);
+}
@@ -0,0 +1,100 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <memory>
+#include <QString>
+#include <QImage>
+
+#include "opencv2/core.hpp"
+
+class ImageSource;
+typedef std::shared_ptr<ImageSource> SourcePtr;
+
+
+// Pixels of the image being annotated, read by region so that images
+// larger than memory can be decoded a piece at a time. Pixels are
+// QImage::Format_RGB32 (0xffRRGGBB, B G R A bytes in memory) viewed as
+// cv::Mat4b, so the same buffer works with Qt and OpenCV.
+class ImageSource {
+
+public:
+    virtual ~ImageSource() {}
+
+    virtual cv::Size size() const = 0;
+
+    // Pixels of r, which must lie within the image. dst may share memory
+    // with the source and should be treated as read only.
+    virtual void read(cv::Rect const &r, cv::Mat4b &dst) const = 0;
+
+    // Pixels of r resized to size (smaller than r), from a reduced
+    // resolution level where the source has one
+    virtual void readScaled(cv::Rect const &r, cv::Size const &size, cv::Mat4b &dst) const;
+
+    // The whole image if it is held in memory, otherwise empty
+    virtual cv::Mat4b dense() const { return cv::Mat4b(); }
+};
+
+
+// The pixels of image in place, image must be Format_RGB32
+inline cv::Mat4b matView(QImage const &image) {
+    uchar *bits = const_cast<uchar*>(image.constBits());
+    return cv::Mat4b(image.height(), image.width(), reinterpret_cast<cv::Vec4b*>(bits), image.bytesPerLine());
+}
+
+
+// A whole decoded image. The QImage owns the pixels (shared, reference
+// counted) and the Mat views them.
+class BufferSource : public ImageSource {
+
+public:
+    BufferSource(QImage const &image) : image(image), pixels(matView(image)) {}
+
+    cv::Size size() const { return pixels.size(); }
+
+    void read(cv::Rect const &r, cv::Mat4b &dst) const {
+        dst = pixels(r);
+    }
+
+    cv::Mat4b dense() const { return pixels; }
+
+    QImage const &qimage() const { return image; }
+
+private:
+    QImage image;
+    cv::Mat4b pixels;
+};
+
+
+// A reduced decode standing in for an image of the given size while the
+// full image loads, regions are scaled up from the preview
+class PreviewSource : public ImageSource {
+
+public:
+    PreviewSource(QImage const &preview, cv::Size const &full)
+        : image(preview), preview(matView(preview)), full(full) {}
+
+    cv::Size size() const { return full; }
+
+    void read(cv::Rect const &r, cv::Mat4b &dst) const {
+        readScaled(r, r.size(), dst);
+    }
+
+    void readScaled(cv::Rect const &r, cv::Size const &size, cv::Mat4b &dst) const;
+
+private:
+    QImage image;
+    cv::Mat4b preview;
+    cv::Size full;
+};
+
+
+// Decoded straight to Format_RGB32 where Qt reads the format, scaled while
+// decoding if scaled is valid (JPEGs decode at a fraction of the cost).
+// Bytes copied converting after decoding are added to copied.
+QImage decodeImage(QString const &path, QSize const &scaled, size_t &copied);
+
+// Tiled TIFF files are decoded on demand, anything else is read whole and
+// kept compressed if it is large. Null if the image can't be read.
+SourcePtr openImage(QString const &path, size_t &copied);
+
+#endif // SOURCE_H
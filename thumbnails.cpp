@@ -0,0 +1,252 @@
+#include "thumbnails.h"
+#include "compositor.h"
+#include "maskio.h"
+#include "source.h"
+
+#include <QtConcurrent>
+#include <QThread>
+#include <QDir>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QCryptographicHash>
+
+#include <algorithm>
+
+#include <opencv2/imgcodecs.hpp>
+
+
+namespace {
+    QString const cacheName = ".thumbnails";
+    int const quality = 85;
+
+
+    // Reduced resolution decode fitting a thumbnail: JPEGs are scaled by the
+    // decoder and tiled TIFFs read from their smallest level that fits
+    QImage decodeThumbnail(QString const &path) {
+        QString suffix = QFileInfo(path).suffix().toLower();
+        size_t copied = 0;
+
+        if(suffix == "tif" || suffix == "tiff") {
+            SourcePtr source = openImage(path, copied);
+            if(!source)
+                return QImage();
+
+            cv::Size full = source->size();
+            QSize scaled = QSize(full.width, full.height).scaled(ThumbnailCache::size, ThumbnailCache::size, Qt::KeepAspectRatio);
+
+            cv::Mat4b pixels;
+            source->readScaled(cv::Rect(cv::Point(), full), cv::Size(scaled.width(), scaled.height()), pixels);
+
+            QImage image(scaled, QImage::Format_RGB32);
+            cv::Mat4b dst = matView(image);
+            pixels.copyTo(dst);
+
+            return image;
+        }
+
+        // before EXIF rotation, as decodeImage scales it
+        QSize stored = QImageReader(path).size();
+        if(!stored.isValid()) {
+            QImage image = decodeImage(path, QSize(), copied);
+            return image.isNull() ? image : image.scaled(ThumbnailCache::size, ThumbnailCache::size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        }
+
+        return decodeImage(path, stored.scaled(ThumbnailCache::size, ThumbnailCache::size, Qt::KeepAspectRatio), copied);
+    }
+
+
+    // Nearest label to the centre of each thumbnail pixel
+    LabelMat sampleMask(MaskStore const &mask, QSize const &size) {
+        LabelMat labels(size.height(), size.width());
+
+        std::vector<label_t> buffer(mask.cols);
+        std::vector<int> columns(size.width());
+
+        for(int x = 0; x < size.width(); ++x) {
+            columns[x] = std::min<int>(mask.cols - 1, (x + 0.5f) * mask.cols / size.width());
+        }
+
+        for(int y = 0; y < size.height(); ++y) {
+            int row = std::min<int>(mask.rows - 1, (y + 0.5f) * mask.rows / size.height());
+
+            label_t const *src = mask.row(row, 0, mask.cols, buffer.data());
+            gatherLabels(src, columns.data(), labels.ptr<label_t>(y), size.width());
+        }
+
+        return labels;
+    }
+}
+
+
+ThumbnailCache::ThumbnailCache(QObject *parent)
+    : QObject(parent), memory(maxThumbnails), running(0), generation(0) {
+
+    // leaves cores for the image being annotated
+    pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() / 2));
+
+    connect(this, &ThumbnailCache::made, this, [=] (QString const &path, QImage const &image, int status, int madeWith) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queued.remove(path);
+        }
+
+        // made before the colours or the image changed, asked for again
+        if(madeWith == generation && !stale.remove(path)) {
+            memory.insert(path, new Thumbnail{image.isNull() ? QPixmap() : QPixmap::fromImage(image), status});
+        }
+
+        emit ready(path);
+    }, Qt::QueuedConnection);
+}
+
+ThumbnailCache::~ThumbnailCache() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.clear();
+    }
+
+    pool.waitForDone();
+}
+
+
+ThumbnailCache::Thumbnail const *ThumbnailCache::find(QString const &path) {
+    Thumbnail const *thumbnail = memory.object(path);
+    if(!thumbnail) request(path);
+
+    return thumbnail;
+}
+
+
+void ThumbnailCache::setColors(QVector<QRgb> const &palette) {
+    auto lut = std::make_shared<BlendLut>();
+    makeBlendLut(palette, opacity, *lut);
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    colors = lut;
+    ++generation;
+
+    memory.clear();
+    stale.clear();
+}
+
+
+void ThumbnailCache::refresh(QString const &path) {
+    memory.remove(path);
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // one being made may have read the old files
+    if(queued.contains(path) && std::find(pending.begin(), pending.end(), path) == pending.end()) {
+        stale.insert(path);
+    }
+}
+
+
+void ThumbnailCache::request(QString const &path) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if(queued.contains(path)) {
+        // still waiting, to the front of the queue
+        auto i = std::find(pending.begin(), pending.end(), path);
+        if(i != pending.end()) {
+            pending.erase(i);
+            pending.push_back(path);
+        }
+
+        return;
+    }
+
+    queued.insert(path);
+    pending.push_back(path);
+
+    // scrolled past, asked for again if it comes back into view
+    if(pending.size() > maxPending) {
+        queued.remove(pending.front());
+        pending.pop_front();
+    }
+
+    if(running < pool.maxThreadCount()) {
+        ++running;
+        QtConcurrent::run(&pool, [=] () { drain(); });
+    }
+}
+
+
+void ThumbnailCache::drain() {
+    while(true) {
+        QString path;
+        LutPtr lut;
+        int madeWith;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if(pending.empty()) {
+                --running;
+                return;
+            }
+
+            path = pending.back();
+            pending.pop_back();
+
+            lut = colors;
+            madeWith = generation;
+        }
+
+        int status = 0;
+        QImage image = make(path, lut, status);
+
+        emit made(path, image, status, madeWith);
+    }
+}
+
+
+QImage ThumbnailCache::make(QString const &path, LutPtr const &colors, int &status) {
+    QFileInfo image(path), mask(path + ".mask");
+
+    status = (mask.exists() ? Annotated : 0) | (QFileInfo(path + ".model").isDir() ? Predicted : 0);
+
+    QString key = QString("%1\n%2\n%3").arg(image.absoluteFilePath())
+            .arg(image.lastModified().toMSecsSinceEpoch())
+            .arg(mask.exists() ? mask.lastModified().toMSecsSinceEpoch() : -1);
+
+    QDir dir(image.absolutePath() + "/" + cacheName);
+    QString stem = dir.filePath(QString::fromLatin1(QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex()));
+
+    QImage thumbnail(stem + ".jpg");
+    LabelMat labels;
+
+    if(mask.exists()) {
+        labels = readMaskImage(stem + ".png");
+    }
+
+    if(thumbnail.isNull() || (mask.exists() && labels.empty())) {
+        thumbnail = decodeThumbnail(path);
+        if(thumbnail.isNull())
+            return thumbnail;
+
+        if(mask.exists()) {
+            MaskPtr m = readMask(mask.absoluteFilePath());
+            if(m) labels = sampleMask(*m, thumbnail.size());
+        }
+
+        // a read only dataset just isn't cached
+        if(dir.mkpath(".")) {
+            thumbnail.save(stem + ".jpg", "JPG", quality);
+            if(!labels.empty()) cv::imwrite((stem + ".png").toStdString(), labels);
+        }
+    }
+
+    if(thumbnail.format() != QImage::Format_RGB32) {
+        thumbnail = thumbnail.convertToFormat(QImage::Format_RGB32);
+    }
+
+    if(colors && labels.cols == thumbnail.width() && labels.rows == thumbnail.height()) {
+        for(int y = 0; y < labels.rows; ++y) {
+            blendLabels(labels.ptr<label_t>(y), *colors, reinterpret_cast<uint32_t*>(thumbnail.scanLine(y)), labels.cols);
+        }
+    }
+
+    return thumbnail;
+}
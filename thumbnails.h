@@ -0,0 +1,79 @@
+#ifndef THUMBNAILS_H
+#define THUMBNAILS_H
+
+#include <QObject>
+#include <QCache>
+#include <QSet>
+#include <QPixmap>
+#include <QVector>
+#include <QThreadPool>
+
+#include <deque>
+#include <mutex>
+#include <memory>
+
+#include "kernels.h"
+
+
+// Thumbnails of images with their masks overlaid, made on a few worker
+// threads from reduced resolution decodes. Made thumbnails are kept on disk
+// in the image's directory, keyed by the path and modification times of the
+// image and its mask, and the most recently used are also kept in memory.
+// Only a bounded number of requests wait, newest first, so scrolling quickly
+// past images doesn't leave a backlog of ones no longer in view.
+class ThumbnailCache : public QObject {
+    Q_OBJECT
+
+public:
+    enum { size = 128, opacity = 50 };    // longest side, of the mask overlay
+    enum { maxPending = 256, maxThumbnails = 1024 };
+
+    enum Status { Annotated = 1, Predicted = 2 };
+
+    struct Thumbnail {
+        QPixmap pixmap;     // null if the image can't be read
+        int status;
+    };
+
+    ThumbnailCache(QObject *parent = nullptr);
+    ~ThumbnailCache();
+
+    // Null until the thumbnail is made, when ready is emitted
+    Thumbnail const *find(QString const &path);
+
+    // Colours of the mask overlay, thumbnails are made again
+    void setColors(QVector<QRgb> const &palette);
+
+    // Made again after the image or its mask has changed
+    void refresh(QString const &path);
+
+signals:
+    void ready(QString const &path);
+
+    // From the workers, received on the thread of the cache
+    void made(QString const &path, QImage const &image, int status, int generation);
+
+private:
+    typedef std::shared_ptr<BlendLut const> LutPtr;
+
+    // Run on the pool, a null image if the image can't be read
+    static QImage make(QString const &path, LutPtr const &colors, int &status);
+
+    void request(QString const &path);
+    void drain();
+
+    QCache<QString, Thumbnail> memory;
+    QSet<QString> stale;            // being made when refreshed
+
+    QThreadPool pool;
+
+    std::mutex mutex;
+    std::deque<QString> pending;    // newest last
+    QSet<QString> queued;           // pending or being made
+    int running;
+
+    int generation;     // of the colours
+    LutPtr colors;
+};
+
+#endif // THUMBNAILS_H
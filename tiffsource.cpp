@@ -0,0 +1,104 @@
+#include "tiffsource.h"
+
+#include <tiffio.h>
+#include <cmath>
+
+
+namespace {
+
+    bool readLevelInfo(TIFF *tiff, cv::Size &size, cv::Size &tile) {
+        uint32_t width = 0, height = 0, tileWidth = 0, tileHeight = 0;
+
+        if(!TIFFIsTiled(tiff)
+                || !TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width) || !TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height)
+                || !TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &tileWidth) || !TIFFGetField(tiff, TIFFTAG_TILELENGTH, &tileHeight))
+            return false;
+
+        size = cv::Size(width, height);
+        tile = cv::Size(tileWidth, tileHeight);
+
+        return width > 0 && height > 0 && tileWidth > 0 && tileHeight > 0;
+    }
+}
+
+
+SourcePtr TiffSource::open(QString const &path, size_t cacheBytes) {
+    std::string file = path.toStdString();
+
+    TIFF *tiff = TIFFOpen(file.c_str(), "r");
+    if(!tiff)
+        return SourcePtr();
+
+    std::shared_ptr<TiffSource> source(new TiffSource(cacheBytes));
+
+    // find the full image and any reduced levels: later tiled directories
+    // of the same aspect ratio (labels and thumbnails are usually stripped)
+    std::vector<tdir_t> directories;
+    std::vector<Level> levels;
+
+    do {
+        cv::Size size, tile;
+        if(!readLevelInfo(tiff, size, tile))
+            continue;
+
+        if(!levels.empty()) {
+            float aspect = float(levels[0].size.width) / levels[0].size.height;
+            if(size.width >= levels.back().size.width
+                    || std::abs(float(size.width) / size.height - aspect) > 0.02f * aspect)
+                continue;
+        }
+
+        directories.push_back(TIFFCurrentDirectory(tiff));
+        levels.push_back(Level(size, tile));
+
+    } while(TIFFReadDirectory(tiff));
+
+    TIFFClose(tiff);
+
+    // a handle per level, so reads don't have to switch directories
+    for(size_t i = 0; i < directories.size(); ++i) {
+        TIFF *handle = TIFFOpen(file.c_str(), "r");
+
+        if(handle && !TIFFSetDirectory(handle, directories[i])) {
+            TIFFClose(handle);
+            handle = nullptr;
+        }
+
+        if(!handle) break;
+
+        source->handles.push_back(handle);
+        source->levels.push_back(levels[i]);
+    }
+
+    return source->levels.empty() ? SourcePtr() : source;
+}
+
+
+TiffSource::~TiffSource() {
+    for(TIFF *handle : handles) {
+        TIFFClose(handle);
+    }
+}
+
+
+cv::Mat4b TiffSource::decodeTile(int level, int tx, int ty) const {
+    cv::Size tile = levels[level].tile;
+    cv::Rect r = tileRect(level, tx, ty);
+
+    // decoded in place: libtiff gives any photometric or compression as
+    // R G B A bytes, bottom row first
+    cv::Mat4b raster(tile.height, tile.width);
+    uint32_t *p = reinterpret_cast<uint32_t*>(raster.data);
+
+    if(TIFFReadRGBATile(handles[level], r.x, r.y, p)) {
+        for(int i = 0; i < tile.area(); ++i) {
+            p[i] = 0xff000000 | (p[i] & 0x0000ff00) | ((p[i] & 0xff) << 16) | ((p[i] >> 16) & 0xff);
+        }
+
+        cv::flip(raster, raster, 0);
+    } else {
+        raster = cv::Vec4b(0, 0, 0, 255);
+    }
+
+    return raster(cv::Rect(0, 0, r.width, r.height));
+}
@@ -0,0 +1,30 @@
+#ifndef TIFFSOURCE_H
+#define TIFFSOURCE_H
+
+#include "tiled.h"
+
+typedef struct tiff TIFF;
+
+
+// Tiled (Big)TIFF decoded a tile at a time. Further tiled directories of
+// the same shape are used as reduced resolution levels.
+class TiffSource : public TiledSource {
+
+public:
+    enum { defaultCache = 256 << 20 };
+
+    // Null unless path is a tiled TIFF
+    static SourcePtr open(QString const &path, size_t cacheBytes = defaultCache);
+
+    ~TiffSource();
+
+protected:
+    cv::Mat4b decodeTile(int level, int tx, int ty) const;
+
+private:
+    TiffSource(size_t cacheBytes) : TiledSource(cacheBytes) {}
+
+    std::vector<TIFF*> handles;     // one per level
+};
+
+#endif // TIFFSOURCE_H
@@ -0,0 +1,102 @@
+#include "tiled.h"
+
+#include <cmath>
+
+#include <opencv2/imgproc.hpp>
+
+
+cv::Rect TiledSource::tileRect(int level, int tx, int ty) const {
+    Level const &l = levels[level];
+
+    cv::Rect r(tx * l.tile.width, ty * l.tile.height, l.tile.width, l.tile.height);
+    return r & cv::Rect(cv::Point(), l.size);
+}
+
+
+TiledSource::TilePtr TiledSource::tile(int level, int tx, int ty) const {
+    uint64_t key = (uint64_t(level) << 48) | (uint64_t(ty) << 24) | uint64_t(tx);
+
+    auto i = cache.find(key);
+    if(i != cache.end()) {
+        recent.splice(recent.begin(), recent, i->second.used);
+        return i->second.tile;
+    }
+
+    auto pixels = std::make_shared<cv::Mat4b const>(decodeTile(level, tx, ty));
+    size_t bytes = pixels->total() * pixels->elemSize();
+
+    while(cached + bytes > cacheBytes && !recent.empty()) {
+        auto oldest = cache.find(recent.back());
+        cached -= oldest->second.tile->total() * oldest->second.tile->elemSize();
+
+        cache.erase(oldest);
+        recent.pop_back();
+    }
+
+    recent.push_front(key);
+    cache[key] = CacheEntry{pixels, recent.begin()};
+    cached += bytes;
+
+    return pixels;
+}
+
+
+void TiledSource::readLevel(int level, cv::Rect const &r, cv::Size const &size, cv::Mat4b &dst) const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Level const &l = levels[level];
+    dst = cv::Mat4b(size, cv::Vec4b(0, 0, 0, 255));
+
+    double sx = double(size.width) / r.width;
+    double sy = double(size.height) / r.height;
+
+    for(int ty = r.y / l.tile.height; ty * l.tile.height < r.y + r.height; ++ty) {
+        for(int tx = r.x / l.tile.width; tx * l.tile.width < r.x + r.width; ++tx) {
+            cv::Rect bounds = tileRect(level, tx, ty);
+            cv::Rect covered = bounds & r;
+
+            // where the covered part lands in dst
+            cv::Rect target(cv::Point(std::lround((covered.x - r.x) * sx), std::lround((covered.y - r.y) * sy)),
+                            cv::Point(std::lround((covered.br().x - r.x) * sx), std::lround((covered.br().y - r.y) * sy)));
+
+            if(target.area() == 0)
+                continue;
+
+            TilePtr pixels = tile(level, tx, ty);
+            cv::Mat4b src = (*pixels)(covered - bounds.tl());
+
+            if(target.size() == covered.size()) {
+                src.copyTo(dst(target));
+            } else {
+                cv::Mat4b out = dst(target);
+                cv::resize(src, out, target.size(), 0, 0, cv::INTER_AREA);
+            }
+        }
+    }
+}
+
+
+void TiledSource::read(cv::Rect const &r, cv::Mat4b &dst) const {
+    readLevel(0, r, r.size(), dst);
+}
+
+
+void TiledSource::readScaled(cv::Rect const &r, cv::Size const &size, cv::Mat4b &dst) const {
+    // smallest level which is still at least the requested resolution
+    float factor = float(r.width) / size.width;
+    size_t best = 0;
+
+    for(size_t i = 1; i < levels.size(); ++i) {
+        if(float(levels[0].size.width) / levels[i].size.width <= factor) best = i;
+    }
+
+    Level const &l = levels[best];
+    float sx = float(l.size.width) / levels[0].size.width;
+    float sy = float(l.size.height) / levels[0].size.height;
+
+    cv::Rect scaled(cv::Point(std::floor(r.x * sx), std::floor(r.y * sy)),
+                    cv::Point(std::ceil(r.br().x * sx), std::ceil(r.br().y * sy)));
+
+    scaled &= cv::Rect(cv::Point(), l.size);
+    readLevel(best, scaled, size, dst);
+}
@@ -0,0 +1,61 @@
+#ifndef TILED_H
+#define TILED_H
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "source.h"
+
+
+// A source stored as tiles, possibly at several resolutions (level 0 is the
+// full image). Tiles are decoded on demand and kept in a cache of bounded
+// size, least recently used first out.
+class TiledSource : public ImageSource {
+
+public:
+    cv::Size size() const { return levels[0].size; }
+
+    void read(cv::Rect const &r, cv::Mat4b &dst) const;
+    void readScaled(cv::Rect const &r, cv::Size const &size, cv::Mat4b &dst) const;
+
+protected:
+    TiledSource(size_t cacheBytes) : cacheBytes(cacheBytes), cached(0) {}
+
+    struct Level {
+        Level(cv::Size const &size, cv::Size const &tile) : size(size), tile(tile) {}
+
+        cv::Size size;
+        cv::Size tile;
+    };
+
+    cv::Rect tileRect(int level, int tx, int ty) const;
+
+    // Pixels of tileRect(level, tx, ty), called with the cache locked
+    virtual cv::Mat4b decodeTile(int level, int tx, int ty) const = 0;
+
+    std::vector<Level> levels;
+
+private:
+    typedef std::shared_ptr<cv::Mat4b const> TilePtr;
+
+    struct CacheEntry {
+        TilePtr tile;
+        std::list<uint64_t>::iterator used;
+    };
+
+    TilePtr tile(int level, int tx, int ty) const;
+
+    // Pixels of r (in level coordinates) resized to size, a tile at a time
+    void readLevel(int level, cv::Rect const &r, cv::Size const &size, cv::Mat4b &dst) const;
+
+    size_t cacheBytes;
+
+    mutable std::mutex mutex;
+    mutable size_t cached;
+    mutable std::map<uint64_t, CacheEntry> cache;
+    mutable std::list<uint64_t> recent;       // most recently used at the front
+};
+
+#endif // TILED_H
@@ -0,0 +1,187 @@
+#include "tiles.h"
+#include "kernels.h"
+
+#include <cstring>
+
+
+template<typename T>
+TileMask_<T>::TileMask_(int rows, int cols, int label)
+    : MaskStore_<T>(rows, cols),
+      tilesX((cols + tileSize - 1) / tileSize), tilesY((rows + tileSize - 1) / tileSize),
+      tiles(tilesX * tilesY, Tile(label)) {
+}
+
+template<typename T>
+TileMask_<T>::TileMask_(MaskStore_<T> const &mask)
+    : TileMask_(mask.rows, mask.cols, 0) {
+
+    for(int ty = 0; ty < tilesY; ++ty) {
+        for(int tx = 0; tx < tilesX; ++tx) {
+            cv::Rect r = tileRect(tx, ty);
+
+            auto data = std::make_shared<Labels>();
+            mask.read(r, *data);
+
+            int label = data->template ptr<T>(0)[0];
+            bool flat = true;
+
+            for(int y = 0; y < r.height && flat; ++y) {
+                T const *labels = data->template ptr<T>(y);
+                flat = labels[0] == label && runLength(labels, r.width) == r.width;
+            }
+
+            Tile &t = tile(tx, ty);
+            t.label = label;
+
+            if(!flat) t.data = data;
+        }
+    }
+}
+
+
+template<typename T>
+cv::Rect TileMask_<T>::tileRect(int tx, int ty) const {
+    cv::Rect r(tx * tileSize, ty * tileSize, tileSize, tileSize);
+    return r & cv::Rect(0, 0, this->cols, this->rows);
+}
+
+template<typename T>
+typename TileMask_<T>::Labels &TileMask_<T>::writable(int tx, int ty) {
+    Tile &t = tile(tx, ty);
+
+    if(!t.data) {
+        cv::Rect r = tileRect(tx, ty);
+        t.data = std::make_shared<Labels>(r.height, r.width, T(t.label));
+
+    } else if(t.data.use_count() > 1) {
+        t.data = std::make_shared<Labels>(t.data->clone());
+    }
+
+    return *t.data;
+}
+
+
+template<typename T>
+T const *TileMask_<T>::row(int y, int x0, int x1, T *buffer) const {
+    int ty = y / tileSize;
+    int ry = y - ty * tileSize;
+
+    for(int x = x0; x < x1; ) {
+        int tx = x / tileSize;
+        int end = std::min(x1, (tx + 1) * tileSize);
+
+        Tile const &t = tile(tx, ty);
+        if(t.data) {
+            T const *src = t.data->template ptr<T>(ry) + (x - tx * tileSize);
+
+            // the whole request lies in one tile
+            if(x == x0 && end == x1) return src;
+            std::memcpy(buffer + (x - x0), src, (end - x) * sizeof(T));
+
+        } else {
+            std::fill(buffer + (x - x0), buffer + (end - x0), T(t.label));
+        }
+
+        x = end;
+    }
+
+    return buffer;
+}
+
+
+template<typename T>
+void TileMask_<T>::fillSpan(int y, int x0, int x1, int label) {
+    int ty = y / tileSize;
+    int ry = y - ty * tileSize;
+
+    for(int x = x0; x < x1; ) {
+        int tx = x / tileSize;
+        int end = std::min(x1, (tx + 1) * tileSize);
+
+        Tile const &t = tile(tx, ty);
+        if(t.data || t.label != label) {
+            T *dst = writable(tx, ty).template ptr<T>(ry) + (x - tx * tileSize);
+            std::fill(dst, dst + (end - x), T(label));
+        }
+
+        x = end;
+    }
+}
+
+template<typename T>
+void TileMask_<T>::writeRow(int y, int x0, int x1, T const *labels) {
+    int ty = y / tileSize;
+    int ry = y - ty * tileSize;
+
+    for(int x = x0; x < x1; ) {
+        int tx = x / tileSize;
+        int end = std::min(x1, (tx + 1) * tileSize);
+
+        T const *src = labels + (x - x0);
+        Tile const &t = tile(tx, ty);
+
+        // writing a tile's own label leaves it unallocated
+        if(t.data || src[0] != t.label || runLength(src, end - x) < end - x) {
+            std::memcpy(writable(tx, ty).template ptr<T>(ry) + (x - tx * tileSize), src, (end - x) * sizeof(T));
+        }
+
+        x = end;
+    }
+}
+
+
+template<typename T>
+void TileMask_<T>::fillRect(cv::Rect const &r, int label) {
+    if(r.area() == 0)
+        return;
+
+    for(int ty = r.y / tileSize; ty <= (r.y + r.height - 1) / tileSize; ++ty) {
+        for(int tx = r.x / tileSize; tx <= (r.x + r.width - 1) / tileSize; ++tx) {
+            cv::Rect tr = tileRect(tx, ty);
+            cv::Rect covered = tr & r;
+
+            Tile &t = tile(tx, ty);
+
+            if(covered == tr) {
+                t.data.reset();
+                t.label = label;
+
+            } else if(t.data || t.label != label) {
+                writable(tx, ty)(covered - tr.tl()) = T(label);
+            }
+        }
+    }
+}
+
+
+template<typename T>
+bool TileMask_<T>::uniform(int y, int x0, int x1, int &label) const {
+    int ty = y / tileSize;
+
+    for(int tx = x0 / tileSize; tx * tileSize < x1; ++tx) {
+        Tile const &t = tile(tx, ty);
+
+        if(t.data || (tx > x0 / tileSize && t.label != label))
+            return false;
+
+        label = t.label;
+    }
+
+    return true;
+}
+
+
+template<typename T>
+size_t TileMask_<T>::bytes() const {
+    size_t n = sizeof(*this) + tiles.size() * sizeof(Tile);
+
+    for(auto const &t : tiles) {
+        if(t.data) n += t.data->total() * sizeof(T);
+    }
+
+    return n;
+}
+
+
+template class TileMask_<uint8_t>;
+template class TileMask_<uint16_t>;
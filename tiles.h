@@ -0,0 +1,59 @@
+#ifndef TILES_H
+#define TILES_H
+
+#include <vector>
+
+#include "mask.h"
+
+
+// Labels stored as square tiles. A tile which has never been written is just
+// a label and costs no memory, tiles are allocated on first write and shared
+// between copies until one of them writes to it.
+template<typename T>
+class TileMask_ : public MaskStore_<T> {
+
+public:
+    typedef typename MaskStore_<T>::Ptr Ptr;
+    typedef typename MaskStore_<T>::Labels Labels;
+
+    enum { tileSize = 256 };
+
+    TileMask_(int rows, int cols, int label);
+    TileMask_(MaskStore_<T> const &mask);
+
+    T const *row(int y, int x0, int x1, T *buffer) const;
+
+    void fillSpan(int y, int x0, int x1, int label);
+    void writeRow(int y, int x0, int x1, T const *labels);
+
+    void fillRect(cv::Rect const &r, int label);
+
+    bool uniform(int y, int x0, int x1, int &label) const;
+
+    Ptr snapshot() const { return clone(); }
+    Ptr clone() const { return std::make_shared<TileMask_>(*this); }
+
+    size_t bytes() const;
+
+private:
+
+    struct Tile {
+        Tile(int label) : label(label) {}
+
+        int label;  // of the whole tile while data is null
+        std::shared_ptr<Labels> data;
+    };
+
+    Tile &tile(int tx, int ty) { return tiles[ty * tilesX + tx]; }
+    Tile const &tile(int tx, int ty) const { return tiles[ty * tilesX + tx]; }
+
+    cv::Rect tileRect(int tx, int ty) const;
+    Labels &writable(int tx, int ty);
+
+    int tilesX, tilesY;
+    std::vector<Tile> tiles;
+};
+
+typedef TileMask_<label_t> TileMask;
+
+#endif // TILES_H
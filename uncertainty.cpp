@@ -0,0 +1,190 @@
+#include "uncertainty.h"
+
+#include <QtConcurrent>
+#include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+
+namespace {
+    QString const cacheName = ".uncertainty.json";
+
+    // newest of the probability maps, -1 if there are none
+    qint64 modelModified(QString const &modelDir) {
+        qint64 modified = -1;
+
+        for(auto const &f : QDir(modelDir).entryInfoList(QStringList() << "class*.jpg", QDir::Files)) {
+            modified = std::max(modified, f.lastModified().toMSecsSinceEpoch());
+        }
+
+        return modified;
+    }
+}
+
+
+float predictionUncertainty(QString const &modelDir) {
+    cv::Mat1b first, second;
+
+    for(int i = 0; ; ++i) {
+        // a quarter size decode is plenty for an average
+        QString path = modelDir + QString("/class%1.jpg").arg(i);
+        cv::Mat1b p = cv::imread(path.toStdString(), cv::IMREAD_REDUCED_GRAYSCALE_4);
+
+        if(p.empty())
+            break;
+
+        if(first.empty()) {
+            first = p;
+            second = cv::Mat1b(p.size(), uint8_t(0));
+
+        } else if(p.size() == first.size()) {
+            second = cv::max(second, cv::min(first, p));
+            first = cv::max(first, p);
+        }
+    }
+
+    if(first.empty())
+        return -1;
+
+    return 1.0f - float(cv::mean(first - second)[0]) / 255.0f;
+}
+
+
+
+UncertaintyQueue::UncertaintyQueue(QObject *parent)
+    : QObject(parent), modified(false) {
+
+    connect(&watcher, &QFutureWatcher<Scored>::resultReadyAt, [=](int i) {
+        Scored s = watcher.resultAt(i);
+        auto cached = scores.find(s.first);
+
+        if(s.second.score < 0) {
+            if(cached != scores.end()) {
+                scores.erase(cached);
+                modified = true;
+            }
+
+        } else if(cached == scores.end() || cached->second.modified != s.second.modified) {
+            scores[s.first] = s.second;
+            modified = true;
+        }
+    });
+
+    connect(&watcher, &QFutureWatcher<Scored>::progressValueChanged, [=](int value) {
+        emit progress(value, watcher.progressMaximum());
+    });
+
+    connect(&watcher, &QFutureWatcher<Scored>::finished, [=] () {
+        if(modified) save();
+        modified = false;
+
+        emit finished();
+    });
+}
+
+UncertaintyQueue::~UncertaintyQueue() {
+    watcher.cancel();
+    watcher.waitForFinished();
+}
+
+
+UncertaintyQueue::Scored UncertaintyQueue::score(Job const &job) {
+    QString modelDir = job.first + ".model";
+
+    Score s;
+    s.modified = modelModified(modelDir);
+
+    if(s.modified >= 0) {
+        s.score = s.modified == job.second.modified ?
+            job.second.score : predictionUncertainty(modelDir);
+    }
+
+    return Scored(QFileInfo(job.first).fileName(), s);
+}
+
+
+void UncertaintyQueue::scan(QString const &dir_, QFileInfoList const &images) {
+    // a scan in progress keeps what it has scored so far
+    watcher.cancel();
+    watcher.waitForFinished();
+
+    if(dir_ != dir) {
+        dir = dir_;
+        load(dir);
+    }
+
+    QList<Job> jobs;
+    for(auto const &image : images) {
+        auto i = scores.find(image.fileName());
+        jobs.append(Job(image.absoluteFilePath(), i == scores.end() ? Score() : i->second));
+    }
+
+    watcher.setFuture(QtConcurrent::mapped(jobs, &UncertaintyQueue::score));
+}
+
+
+QFileInfoList UncertaintyQueue::order(QFileInfoList const &images) const {
+    std::vector<std::pair<float, int>> scored;
+    QFileInfoList ordered;
+
+    for(int i = 0; i < images.size(); ++i) {
+        auto s = scores.find(images[i].fileName());
+        if(s != scores.end()) scored.push_back(std::make_pair(-s->second.score, i));
+    }
+
+    std::stable_sort(scored.begin(), scored.end());
+
+    std::vector<bool> placed(images.size(), false);
+    for(auto const &s : scored) {
+        ordered.append(images[s.second]);
+        placed[s.second] = true;
+    }
+
+    for(int i = 0; i < images.size(); ++i) {
+        if(!placed[i]) ordered.append(images[i]);
+    }
+
+    return ordered;
+}
+
+
+void UncertaintyQueue::load(QString const &dir) {
+    scores.clear();
+    modified = false;
+
+    QFile file(dir + "/" + cacheName);
+    if(!file.open(QIODevice::ReadOnly))
+        return;
+
+    QJsonObject images = QJsonDocument::fromJson(file.readAll()).object();
+    for(auto i = images.begin(); i != images.end(); ++i) {
+        QJsonObject entry = i.value().toObject();
+
+        Score s;
+        s.modified = qint64(entry["modified"].toDouble());
+        s.score = float(entry["score"].toDouble());
+
+        scores[i.key()] = s;
+    }
+}
+
+void UncertaintyQueue::save() const {
+    QJsonObject images;
+
+    for(auto const &s : scores) {
+        QJsonObject entry;
+        entry["modified"] = double(s.second.modified);
+        entry["score"] = s.second.score;
+
+        images[s.first] = entry;
+    }
+
+    // a read only dataset just isn't cached
+    QFile file(dir + "/" + cacheName);
+    if(file.open(QIODevice::WriteOnly)) {
+        file.write(QJsonDocument(images).toJson());
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef UNCERTAINTY_H
+#define UNCERTAINTY_H
+
+#include <QObject>
+#include <QFileInfo>
+#include <QFutureWatcher>
+
+#include <map>
+
+
+// How unsure the model is about an image, from the class probability maps
+// (class0.jpg, class1.jpg ...) in modelDir: one minus the mean margin between
+// the two most probable classes, in [0, 1]. Negative if there are no maps.
+float predictionUncertainty(QString const &modelDir);
+
+
+// Uncertainty of every image in a directory, scored in the background on all
+// cores. Scores are cached in the directory keyed by the modification time of
+// the probability maps, so a scan only rescores images with new predictions.
+class UncertaintyQueue : public QObject {
+    Q_OBJECT
+
+public:
+    UncertaintyQueue(QObject *parent = nullptr);
+    ~UncertaintyQueue();
+
+    // Score images (in dir) which have new or changed predictions
+    void scan(QString const &dir, QFileInfoList const &images);
+
+    // Most uncertain first, images without predictions after those in the given order
+    QFileInfoList order(QFileInfoList const &images) const;
+
+    bool isScanning() const { return watcher.isRunning(); }
+
+signals:
+    void progress(int scored, int total);
+    void finished();
+
+private:
+    struct Score {
+        Score() : modified(-1), score(-1) {}
+
+        qint64 modified;    // of the probability maps, msecs since epoch
+        float score;
+    };
+
+    typedef std::pair<QString, Score> Scored;  // by file name
+
+    // An image path and what's cached for it
+    typedef std::pair<QString, Score> Job;
+
+    // Run on the thread pool, the cached score if the maps haven't changed
+    static Scored score(Job const &job);
+
+    void load(QString const &dir);
+    void save() const;
+
+    QString dir;
+    std::map<QString, Score> scores;    // by file name
+    bool modified;                      // since the cache was read or written
+
+    QFutureWatcher<Scored> watcher;
+};
+
+#endif // UNCERTAINTY_H
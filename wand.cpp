@@ -0,0 +1,83 @@
+#include "wand.h"
+#include "kernels.h"
+
+#include <cstring>
+
+
+MagicWand::MagicWand(SourcePtr const &source, cv::Point const &seed, int tolerance, cv::Rect const &bounds)
+    : source(source), bounds(bounds), tolerance(std::max(0, std::min(255, tolerance))),
+      state(bounds.size(), uint8_t(unmatched)),
+      bands((bounds.height + bandRows - 1) / bandRows, false),
+      seed(seed - bounds.tl()), started(false), area(0) {
+
+    cv::Mat4b pixel;
+    source->read(cv::Rect(seed, cv::Size(1, 1)), pixel);
+    std::memcpy(&colour, &pixel(0, 0), sizeof(uint32_t));
+}
+
+
+uint8_t *MagicWand::row(int y) {
+    int band = y / bandRows;
+
+    if(!bands[band]) {
+        cv::Rect r(0, band * bandRows, bounds.width, std::min<int>(bandRows, bounds.height - band * bandRows));
+
+        cv::Mat4b pixels;
+        source->read(r + bounds.tl(), pixels);
+
+        for(int i = 0; i < r.height; ++i) {
+            colourMatch(reinterpret_cast<uint32_t const*>(pixels.ptr(i)), colour, tolerance, state.ptr(r.y + i), r.width);
+        }
+
+        bands[band] = true;
+    }
+
+    return state.ptr(y);
+}
+
+
+// fill every span of matching pixels in row y reachable from [x0, x1)
+int MagicWand::scan(int y, int x0, int x1, Spans &spans) {
+    uint8_t *labels = row(y);
+    int n = 0;
+
+    for(int x = x0; x < x1; ) {
+        if(labels[x] != matched) {
+            ++x;
+            continue;
+        }
+
+        int start = x;
+        while(start > 0 && labels[start - 1] == matched) --start;
+        while(x < bounds.width && labels[x] == matched) ++x;
+
+        std::memset(labels + start, filledPixel, x - start);
+        stack.push_back(Span(y, start, x));
+        spans.push_back(Span(y + bounds.y, start + bounds.x, x + bounds.x));
+
+        n += x - start;
+    }
+
+    return n;
+}
+
+
+bool MagicWand::step(int budget, Spans &spans) {
+    int n = 0;
+
+    if(!started) {
+        n += scan(seed.y, seed.x, seed.x + 1, spans);
+        started = true;
+    }
+
+    while(!stack.empty() && n < budget) {
+        Span s = stack.back();
+        stack.pop_back();
+
+        if(s.y > 0) n += scan(s.y - 1, s.x0, s.x1, spans);
+        if(s.y + 1 < bounds.height) n += scan(s.y + 1, s.x0, s.x1, spans);
+    }
+
+    area += n;
+    return !stack.empty();
+}
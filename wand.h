@@ -0,0 +1,51 @@
+#ifndef WAND_H
+#define WAND_H
+
+#include <vector>
+
+#include "opencv2/core.hpp"
+
+#include "source.h"
+#include "raster.h"
+
+
+// Flood fill over the image rather than the labels, growing from a seed
+// over pixels where no channel differs from the seed colour by more than
+// tolerance. Pixels are matched a band of rows at a time as the fill
+// reaches them, and the fill runs a number of pixels per step so that
+// large fills can be spread over frames.
+class MagicWand {
+
+public:
+    enum { bandRows = 256 };
+
+    MagicWand(SourcePtr const &source, cv::Point const &seed, int tolerance, cv::Rect const &bounds);
+
+    // Fill up to budget more pixels, adding their spans (in image
+    // coordinates) to spans. False once the fill is complete.
+    bool step(int budget, Spans &spans);
+
+    int filled() const { return area; }
+
+private:
+    enum { unmatched = 0, filledPixel = 1, matched = 255 };
+
+    uint8_t *row(int y);
+    int scan(int y, int x0, int x1, Spans &spans);
+
+    SourcePtr source;
+    cv::Rect bounds;
+
+    uint32_t colour;
+    int tolerance;
+
+    cv::Mat1b state;            // over bounds
+    std::vector<bool> bands;    // of state which have been matched
+
+    cv::Point seed;
+    Spans stack;
+    bool started;
+    int area;
+};
+
+#endif // WAND_H
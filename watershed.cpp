@@ -0,0 +1,500 @@
+#include "watershed.h"
+
+#include <QtConcurrent>
+
+#include <cmath>
+#include <map>
+#include <unordered_map>
+
+#include <opencv2/imgproc.hpp>
+
+
+namespace {
+
+    // blocks the fill is written to the layer in
+    int const blockSize = 256;
+
+    // larger images only have basins around where they are being worked on
+    int64_t const maxArea = int64_t(16) << 20;
+
+    // rows of the gradient found at a time, and the rows around them the filters need
+    int const bandRows = 256;
+    int const bandMargin = 4;
+
+
+    // Grow labels (0 for none) into the pixels open allows, lowest gradient first
+    template<typename Open>
+    void flood(cv::Mat1b const &gradient, cv::Mat1i &labels, Open open) {
+        std::vector<std::vector<int64_t>> queues(256);
+        int cols = labels.cols, rows = labels.rows;
+
+        for(int y = 0; y < rows; ++y) {
+            for(int x = 0; x < cols; ++x) {
+                if(labels(y, x)) queues[gradient(y, x)].push_back(int64_t(y) * cols + x);
+            }
+        }
+
+        for(int level = 0; level < 256; ++level) {
+            auto &queue = queues[level];
+
+            while(!queue.empty()) {
+                int64_t i = queue.back();
+                queue.pop_back();
+
+                int x = int(i % cols), y = int(i / cols);
+                int label = labels(y, x);
+
+                auto visit = [&](int u, int v) {
+                    if(labels(v, u) || !open(u, v))
+                        return;
+
+                    labels(v, u) = label;
+                    queues[std::max<int>(level, gradient(v, u))].push_back(int64_t(v) * cols + u);
+                };
+
+                if(x > 0) visit(x - 1, y);
+                if(x + 1 < cols) visit(x + 1, y);
+                if(y > 0) visit(x, y - 1);
+                if(y + 1 < rows) visit(x, y + 1);
+            }
+        }
+    }
+
+
+    cv::Mat1b colourGradient(cv::Mat4b const &pixels) {
+        cv::Mat3b bgr, smooth;
+        cv::cvtColor(pixels, bgr, cv::COLOR_BGRA2BGR);
+        cv::GaussianBlur(bgr, smooth, cv::Size(), 1);
+
+        cv::Mat3f dx, dy;
+        cv::Sobel(smooth, dx, CV_32F, 1, 0);
+        cv::Sobel(smooth, dy, CV_32F, 0, 1);
+
+        // strongest channel
+        cv::Mat1f mag(pixels.size(), 0.0f);
+        for(int y = 0; y < mag.rows; ++y) {
+            for(int x = 0; x < mag.cols; ++x) {
+                cv::Vec3f const &gx = dx(y, x), &gy = dy(y, x);
+
+                for(int c = 0; c < 3; ++c) {
+                    mag(y, x) = std::max(mag(y, x), gx[c] * gx[c] + gy[c] * gy[c]);
+                }
+            }
+        }
+
+        cv::sqrt(mag, mag);
+
+        cv::Mat1b gradient;
+        mag.convertTo(gradient, CV_8U, 0.25);
+        return gradient;
+    }
+}
+
+
+BasinsPtr computeBasins(ImageSource const &source, cv::Rect const &region, int spacing) {
+    auto basins = std::make_shared<Basins>();
+    cv::Size size = region.size();
+    cv::Rect image(cv::Point(), source.size());
+
+    basins->bounds = region;
+    basins->gradient.create(size);
+
+    // a band at a time, so only the gradient is held for all of region
+    for(int y = 0; y < size.height; y += bandRows) {
+        cv::Rect inner(region.x, region.y + y, region.width, std::min<int>(bandRows, size.height - y));
+        cv::Rect outer = cv::Rect(inner.x, inner.y - bandMargin, inner.width, inner.height + 2 * bandMargin) & image;
+
+        cv::Mat4b pixels;
+        source.read(outer, pixels);
+
+        colourGradient(pixels)(inner - outer.tl()).copyTo(basins->gradient.rowRange(y, y + inner.height));
+    }
+
+    cv::Mat1b const &gradient = basins->gradient;
+    cv::Mat1i &labels = basins->labels;
+
+    // a seed at the lowest point of each cell
+    labels = cv::Mat1i(size, 0);
+    int n = 0;
+
+    for(int y = 0; y < size.height; y += spacing) {
+        for(int x = 0; x < size.width; x += spacing) {
+            cv::Rect cell = cv::Rect(x, y, spacing, spacing) & cv::Rect(cv::Point(), size);
+
+            cv::Point lowest;
+            cv::minMaxLoc(gradient(cell), nullptr, nullptr, &lowest);
+
+            labels(cell.tl() + lowest) = ++n;
+        }
+    }
+
+    flood(gradient, labels, [](int, int) { return true; });
+    labels -= 1;
+
+    std::vector<cv::Point> tl(n, cv::Point(size.width, size.height)), br(n, cv::Point(0, 0));
+    std::unordered_map<uint64_t, uint8_t> edges;
+
+    auto join = [&](int a, int b, int saddle) {
+        uint64_t key = (uint64_t(std::min(a, b)) << 32) | uint64_t(std::max(a, b));
+        auto i = edges.find(key);
+
+        if(i == edges.end()) edges[key] = saddle;
+        else i->second = std::min<int>(i->second, saddle);
+    };
+
+    for(int y = 0; y < size.height; ++y) {
+        for(int x = 0; x < size.width; ++x) {
+            int b = labels(y, x);
+
+            tl[b] = cv::Point(std::min(tl[b].x, x), std::min(tl[b].y, y));
+            br[b] = cv::Point(std::max(br[b].x, x + 1), std::max(br[b].y, y + 1));
+
+            if(x + 1 < size.width && labels(y, x + 1) != b)
+                join(b, labels(y, x + 1), std::max(gradient(y, x), gradient(y, x + 1)));
+
+            if(y + 1 < size.height && labels(y + 1, x) != b)
+                join(b, labels(y + 1, x), std::max(gradient(y, x), gradient(y + 1, x)));
+        }
+    }
+
+    for(int b = 0; b < n; ++b) {
+        basins->rects.push_back(cv::Rect(tl[b], br[b]));
+    }
+
+    std::vector<int> degree(n + 1, 0);
+    for(auto const &e : edges) {
+        ++degree[e.first >> 32];
+        ++degree[e.first & 0xffffffff];
+    }
+
+    basins->offsets.assign(n + 1, 0);
+    for(int b = 0; b < n; ++b) {
+        basins->offsets[b + 1] = basins->offsets[b] + degree[b];
+    }
+
+    basins->neighbours.resize(basins->offsets[n]);
+    basins->saddles.resize(basins->offsets[n]);
+
+    std::vector<int> next(basins->offsets.begin(), basins->offsets.end() - 1);
+    for(auto const &e : edges) {
+        int a = int(e.first >> 32), b = int(e.first & 0xffffffff);
+
+        basins->neighbours[next[a]] = b;
+        basins->saddles[next[a]++] = e.second;
+
+        basins->neighbours[next[b]] = a;
+        basins->saddles[next[b]++] = e.second;
+    }
+
+    return basins;
+}
+
+
+
+Watershed::Watershed(QObject *parent)
+    : QObject(parent), unlabelled(0), version(-1) {
+
+    connect(&watcher, &QFutureWatcher<BasinsPtr>::finished, [=] () {
+        if(!source)
+            return;
+
+        // asked for another image or somewhere else meanwhile
+        if(computing != source || watcher.result()->bounds != bounds) {
+            compute(bounds);
+            return;
+        }
+
+        basins = watcher.result();
+
+        reset();
+        update();
+    });
+}
+
+Watershed::~Watershed() {
+    watcher.waitForFinished();
+}
+
+
+void Watershed::start(SourcePtr const &source_, LayerPtr const &layer_, cv::Rect const &view) {
+    if(layer && layer != layer_) layer->setMarking(false);
+
+    layer = layer_;
+    layer->setMarking(true);
+
+    cv::Rect visible = view & cv::Rect(cv::Point(), source_->size());
+
+    if(source_ != source || (visible & bounds) != visible) {
+        source = source_;
+        compute(around(visible));
+
+        return;
+    }
+
+    reset();
+    update();
+}
+
+void Watershed::stop() {
+    if(layer) layer->setMarking(false);
+
+    layer.reset();
+    source.reset();
+    basins.reset();
+
+    bounds = cv::Rect();
+    result.clear();
+}
+
+
+cv::Rect Watershed::around(cv::Rect const &r) const {
+    cv::Size size = source->size();
+    if(int64_t(size.width) * size.height <= maxArea)
+        return cv::Rect(cv::Point(), size);
+
+    // a square of maxArea centred on r, moved inside the image
+    int side = int(std::sqrt(double(maxArea)));
+    int w = std::min(side, size.width), h = std::min(side, size.height);
+
+    int x = std::min(std::max(0, r.x + r.width / 2 - w / 2), size.width - w);
+    int y = std::min(std::max(0, r.y + r.height / 2 - h / 2), size.height - h);
+
+    return cv::Rect(x, y, w, h);
+}
+
+
+void Watershed::compute(cv::Rect const &region) {
+    bounds = region;
+    basins.reset();
+
+    // another is started when this finishes
+    if(watcher.isRunning())
+        return;
+
+    SourcePtr s = computing = source;
+    watcher.setFuture(QtConcurrent::run([=] () {
+        return computeBasins(*s, region);
+    }));
+}
+
+
+void Watershed::reset() {
+    result.clear();
+
+    if(!basins || !layer || (basins->bounds & cv::Rect(cv::Point(), layer->size())) != basins->bounds) {
+        return;
+    }
+
+    int n = basins->count();
+    unlabelled = layer->getDefaultLabel();
+
+    markers.assign(n, -1);
+    mixed.assign(n, 0);
+    result.assign(n, -1);
+
+    // everything changed since before the first version
+    version = -1;
+}
+
+
+void Watershed::update() {
+    if(!isReady())
+        return;
+
+    cv::Rect edited = layer->changedSince(version);
+    cv::Rect dirty = edited & bounds;
+
+    // work has moved off the basins of a large image
+    if(edited.area() && dirty.area() == 0) {
+        compute(around(edited));
+        return;
+    }
+
+    version = layer->getVersion();
+
+    if(dirty.area() == 0)
+        return;
+
+    // in the coordinates of the basins
+    cv::Point origin = bounds.tl();
+    dirty -= origin;
+
+    int n = basins->count();
+    cv::Mat1i const &labels = basins->labels;
+
+    // basins touched by the change, their markers are counted again
+    std::vector<uint8_t> changed(n, 0);
+    std::vector<int> touched;
+    cv::Rect region = dirty;
+
+    for(int y = dirty.y; y < dirty.y + dirty.height; ++y) {
+        for(int x = dirty.x; x < dirty.x + dirty.width; ++x) {
+            int b = labels(y, x);
+
+            if(!changed[b]) {
+                changed[b] = 1;
+                touched.push_back(b);
+                region |= basins->rects[b];
+            }
+        }
+    }
+
+    LabelMat current = layer->getRegion(region + origin);
+    LabelMat marked = layer->getMarks(region + origin);
+    std::map<int, std::map<int, int>> counts;
+
+    for(int y = 0; y < region.height; ++y) {
+        for(int x = 0; x < region.width; ++x) {
+            int b = labels(region.y + y, region.x + x);
+            int label = current(y, x);
+
+            if(changed[b] && marked(y, x))
+                ++counts[b][label];
+        }
+    }
+
+    for(int b : touched) {
+        auto const &c = counts[b];
+
+        markers[b] = -1;
+        mixed[b] = c.size() > 1;
+
+        int most = 0;
+        for(auto const &l : c) {
+            if(l.second > most) {
+                most = l.second;
+                markers[b] = l.first;
+            }
+        }
+    }
+
+    // minimum spanning forest of the basin graph grown from the marked basins
+    std::vector<int> flooded(n, -1);
+    std::vector<std::vector<int>> queues(256);
+
+    for(int b = 0; b < n; ++b) {
+        if(markers[b] >= 0) {
+            flooded[b] = markers[b];
+            queues[0].push_back(b);
+        }
+    }
+
+    for(int level = 0; level < 256; ++level) {
+        auto &queue = queues[level];
+
+        while(!queue.empty()) {
+            int b = queue.back();
+            queue.pop_back();
+
+            for(int i = basins->offsets[b]; i < basins->offsets[b + 1]; ++i) {
+                int c = basins->neighbours[i];
+
+                if(flooded[c] < 0) {
+                    flooded[c] = flooded[b];
+                    queues[std::max<int>(level, basins->saddles[i])].push_back(c);
+                }
+            }
+        }
+    }
+
+    for(int b = 0; b < n; ++b) {
+        if(flooded[b] != result[b]) changed[b] = 1;
+    }
+
+    result.swap(flooded);
+    write(changed);
+
+    // our own writes aren't edits to fill around
+    version = layer->getVersion();
+    emit updated();
+}
+
+
+LabelMat Watershed::floodMixed(int b, LabelMat const &current, LabelMat const &marked) const {
+    cv::Rect r = basins->rects[b];
+    cv::Mat1i const inside = basins->labels(r);
+
+    cv::Mat1i seeds(r.size(), 0);
+    for(int y = 0; y < r.height; ++y) {
+        for(int x = 0; x < r.width; ++x) {
+            int label = current(y, x);
+
+            if(inside(y, x) == b && marked(y, x))
+                seeds(y, x) = label + 1;
+        }
+    }
+
+    flood(basins->gradient(r), seeds, [&](int x, int y) { return inside(y, x) == b; });
+
+    // parts of the basin cut off from its markers take the basin's label
+    int label = result[b] < 0 ? unlabelled : result[b];
+
+    LabelMat labels(r.size());
+    for(int y = 0; y < r.height; ++y) {
+        for(int x = 0; x < r.width; ++x) {
+            labels(y, x) = seeds(y, x) ? seeds(y, x) - 1 : label;
+        }
+    }
+
+    return labels;
+}
+
+
+void Watershed::write(std::vector<uint8_t> const &changed) {
+    cv::Size size = bounds.size();
+    cv::Point origin = bounds.tl();
+
+    int blocksX = (size.width + blockSize - 1) / blockSize;
+    int blocksY = (size.height + blockSize - 1) / blockSize;
+
+    std::vector<uint8_t> blocks(blocksX * blocksY, 0);
+    std::map<int, LabelMat> mixedLabels;
+
+    for(int b = 0; b < basins->count(); ++b) {
+        if(!changed[b])
+            continue;
+
+        cv::Rect r = basins->rects[b];
+        for(int by = r.y / blockSize; by <= (r.br().y - 1) / blockSize; ++by) {
+            for(int bx = r.x / blockSize; bx <= (r.br().x - 1) / blockSize; ++bx) {
+                blocks[by * blocksX + bx] = 1;
+            }
+        }
+
+        if(mixed[b]) mixedLabels[b] = floodMixed(b, layer->getRegion(r + origin), layer->getMarks(r + origin));
+    }
+
+    for(int by = 0; by < blocksY; ++by) {
+        for(int bx = 0; bx < blocksX; ++bx) {
+            if(!blocks[by * blocksX + bx])
+                continue;
+
+            cv::Rect block = cv::Rect(bx * blockSize, by * blockSize, blockSize, blockSize) & cv::Rect(cv::Point(), size);
+            LabelMat current = layer->getRegion(block + origin);
+            LabelMat marked = layer->getMarks(block + origin);
+            bool written = false;
+
+            for(int y = block.y; y < block.br().y; ++y) {
+                for(int x = block.x; x < block.br().x; ++x) {
+                    int b = basins->labels(y, x);
+                    label_t &label = current(y - block.y, x - block.x);
+
+                    if(!changed[b] || marked(y - block.y, x - block.x))
+                        continue;
+
+                    int target = result[b] < 0 ? unlabelled : result[b];
+                    if(mixed[b]) {
+                        target = mixedLabels[b](y - basins->rects[b].y, x - basins->rects[b].x);
+                    }
+
+                    if(label != target) {
+                        label = target;
+                        written = true;
+                    }
+                }
+            }
+
+            if(written) layer->fillRegion(block + origin, current);
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef WATERSHED_H
+#define WATERSHED_H
+
+#include <QObject>
+#include <QFutureWatcher>
+
+#include <vector>
+
+#include "opencv2/core.hpp"
+
+#include "source.h"
+#include "layer.h"
+
+
+// Catchment basins of the colour gradient of a region of an image, an
+// oversegmentation made once per image. Marker floods run over the graph of
+// basins, joined by the lowest gradient on the boundary between each pair,
+// rather than pixels. All but bounds are in the coordinates of bounds.
+struct Basins {
+    cv::Rect bounds;            // of the image
+    cv::Mat1b gradient;
+    cv::Mat1i labels;           // basin of each pixel
+    std::vector<cv::Rect> rects;
+
+    // neighbours of basin b are [offsets[b], offsets[b + 1]) of neighbours and saddles
+    std::vector<int> offsets;
+    std::vector<int> neighbours;
+    std::vector<uint8_t> saddles;
+
+    int count() const { return int(rects.size()); }
+};
+
+typedef std::shared_ptr<Basins const> BasinsPtr;
+
+// One basin per cell of spacing pixels of region, grown from the lowest point of the cell
+BasinsPtr computeBasins(ImageSource const &source, cv::Rect const &region, int spacing = 16);
+
+
+// Marked labels of a layer used as watershed markers, filling its other
+// pixels. Basins are computed in the background when the image changes,
+// after that each update only rewrites basins whose fill has changed.
+// Large images only have basins around the view, moved when edits are
+// made elsewhere.
+class Watershed : public QObject {
+    Q_OBJECT
+
+public:
+    Watershed(QObject *parent = nullptr);
+    ~Watershed();
+
+    void start(SourcePtr const &source, LayerPtr const &layer, cv::Rect const &view);
+    void stop();
+
+    bool isReady() const { return basins && layer && !result.empty(); }
+
+public slots:
+    // Fill again around the changes to the layer since the last update
+    void update();
+
+signals:
+    void updated();
+
+private:
+    void reset();
+
+    // Basins of region computed in the background
+    void compute(cv::Rect const &region);
+
+    // The region basins are computed for to cover r
+    cv::Rect around(cv::Rect const &r) const;
+
+    // Labels of a basin with markers of more than one label, flooded from the
+    // marked pixels. current and marked are of the basin's rect.
+    LabelMat floodMixed(int b, LabelMat const &current, LabelMat const &marked) const;
+    void write(std::vector<uint8_t> const &changed);
+
+    QFutureWatcher<BasinsPtr> watcher;
+    SourcePtr computing;    // by watcher
+    SourcePtr source;
+
+    BasinsPtr basins;
+    cv::Rect bounds;        // of the basins, or those being computed
+    LayerPtr layer;
+
+    int unlabelled;
+    int version;            // of the layer at the last update
+
+    std::vector<int> markers;       // most frequent marker label of each basin, -1 for none
+    std::vector<uint8_t> mixed;     // basin has markers of more than one label
+    std::vector<int> result;        // label flooded into each basin, -1 for none
+};
+
+#endif // WATERSHED_H